@@ -27,7 +27,30 @@
 #include <array>
 #include <list>
 #include <map>
+#include <unordered_map>
+#include <queue>
+#include <memory>
 #include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <future>
+#include <filesystem>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define R2D_SSE2 1
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+// memory mapped asset cache
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #if USE_OPENGL
 // opengl related
@@ -56,6 +79,16 @@
 #include <GLFW/glfw3.h>
 #endif
 
+#if USE_OPENGL
+// image decoding
+#define SDL_MAIN_HANDLED
+    #ifdef __linux__
+    #include "SDL2/SDL_image.h"
+    #elif _WIN32
+    #include "SDL_image.h"
+    #endif
+#endif
+
 /*
 STATIC_ASSERT(expr) assert expr at compile-time
 
@@ -143,6 +176,154 @@ namespace Debug {
     }
 };
 
+/*
+Blend::over(dst, src, count, opacity) blends count RGBA pixels of src
+    scaled by opacity over the opaque pixels of dst, dst alpha stays 255
+
+Blend::solid(dst, count, r, g, b, alpha) blends one color with alpha
+    over count RGBA pixels of dst, dst may be translucent
+*/
+
+namespace Blend {
+    // x / 255 rounded, exact for x <= 65535
+    inline uint32_t div255(uint32_t x) {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+    void over(uint8_t* dst, const uint8_t* src, int32_t count, uint8_t opacity) {
+        int32_t i = 0;
+#if R2D_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i full = _mm_set1_epi16(255);
+        const __m128i half = _mm_set1_epi16(128);
+        const __m128i alphaMask = _mm_set1_epi32(static_cast<int32_t>(0xFF000000));
+        const __m128i scale = _mm_set1_epi32(opacity);
+        for (; i + 4 <= count; i += 4) {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+            __m128i a = _mm_srli_epi32(s, 24);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xFFFF) {
+                continue;
+            }
+            if (opacity == 255 && _mm_movemask_epi8(_mm_cmpeq_epi32(a, _mm_set1_epi32(255))) == 0xFFFF) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), s);
+                continue;
+            }
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+
+            // per pixel alpha * opacity / 255, spread over the four 16 bit channels
+            a = _mm_add_epi16(_mm_mullo_epi16(a, scale), half);
+            a = _mm_srli_epi16(_mm_add_epi16(a, _mm_srli_epi16(a, 8)), 8);
+            a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+            __m128i aLo = _mm_unpacklo_epi32(a, a);
+            __m128i aHi = _mm_unpackhi_epi32(a, a);
+
+            __m128i lo = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), aLo),
+                _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(full, aLo)));
+            __m128i hi = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), aHi),
+                _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(full, aHi)));
+            lo = _mm_add_epi16(lo, half);
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+            hi = _mm_add_epi16(hi, half);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+            __m128i result = _mm_or_si128(_mm_packus_epi16(lo, hi), alphaMask);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), result);
+        }
+#endif
+        for (; i < count; i ++) {
+            const uint8_t* s = src + i * 4;
+            uint8_t* d = dst + i * 4;
+            uint32_t a = div255(s[3] * opacity);
+            if (a == 0) {
+                continue;
+            }
+            d[0] = div255(s[0] * a + d[0] * (255 - a));
+            d[1] = div255(s[1] * a + d[1] * (255 - a));
+            d[2] = div255(s[2] * a + d[2] * (255 - a));
+            d[3] = 255;
+        }
+    }
+
+    void solid(uint8_t* dst, int32_t count, uint8_t r, uint8_t g, uint8_t b, uint8_t alpha) {
+        if (alpha == 0) {
+            return;
+        }
+        const uint8_t pixel[4] = {r, g, b, 255};
+        int32_t i = 0;
+#if R2D_SSE2
+        int32_t packed;
+        memcpy(&packed, pixel, 4);
+        const __m128i color = _mm_set1_epi32(packed);
+        if (alpha == 255) {
+            for (; i + 4 <= count; i += 4) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), color);
+            }
+        } else {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i half = _mm_set1_epi16(128);
+            const __m128i opaque = _mm_set1_epi32(255);
+            const __m128i alphaMask = _mm_set1_epi32(static_cast<int32_t>(0xFF000000));
+            const __m128i inverse = _mm_set1_epi16(255 - alpha);
+            const __m128i source = _mm_mullo_epi16(_mm_unpacklo_epi8(color, zero), _mm_set1_epi16(alpha));
+            // translucent destinations keep one pixel per 32 bit lane, one channel per register
+            const __m128i byteMask = _mm_set1_epi32(0xFF);
+            const __m128i alphaWide = _mm_set1_epi32(alpha);
+            const __m128i inverseWide = _mm_set1_epi32(255 - alpha);
+            const __m128i sourceR = _mm_set1_epi32(r * alpha);
+            const __m128i sourceG = _mm_set1_epi32(g * alpha);
+            const __m128i sourceB = _mm_set1_epi32(b * alpha);
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 bias = _mm_set1_ps(1.0f / 512.0f);
+            for (; i + 4 <= count; i += 4) {
+                __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i * 4));
+                __m128i da = _mm_srli_epi32(d, 24);
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(da, opaque)) != 0xFFFF) {
+                    // keep = div255(da * (255 - alpha)), total = alpha + keep, all below 2^16
+                    __m128i keep = _mm_add_epi32(_mm_mullo_epi16(da, inverseWide), _mm_set1_epi32(128));
+                    keep = _mm_srli_epi32(_mm_add_epi32(keep, _mm_srli_epi32(keep, 8)), 8);
+                    __m128i total = _mm_add_epi32(alphaWide, keep);
+                    __m128i round = _mm_srli_epi32(total, 1);
+                    // total is at least alpha; a fractional quotient sits 1/255 or more below the next integer,
+                    // so a 1/512 bias covers the reciprocal error and truncation matches the integer divide
+                    __m128 reciprocal = _mm_div_ps(one, _mm_cvtepi32_ps(total));
+                    auto divide = [&](__m128i channel, __m128i source) {
+                        __m128i sum = _mm_add_epi32(_mm_add_epi32(source, _mm_mullo_epi16(channel, keep)), round);
+                        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), reciprocal), bias));
+                    };
+                    __m128i result = _mm_or_si128(_mm_slli_epi32(total, 24), divide(_mm_and_si128(d, byteMask), sourceR));
+                    result = _mm_or_si128(result, _mm_slli_epi32(divide(_mm_and_si128(_mm_srli_epi32(d, 8), byteMask), sourceG), 8));
+                    result = _mm_or_si128(result, _mm_slli_epi32(divide(_mm_and_si128(_mm_srli_epi32(d, 16), byteMask), sourceB), 16));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), result);
+                    continue;
+                }
+                __m128i lo = _mm_add_epi16(_mm_add_epi16(source, _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inverse)), half);
+                __m128i hi = _mm_add_epi16(_mm_add_epi16(source, _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inverse)), half);
+                lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+                hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_packus_epi16(lo, hi), alphaMask));
+            }
+        }
+#endif
+        for (; i < count; i ++) {
+            uint8_t* d = dst + i * 4;
+            if (alpha == 255) {
+                memcpy(d, pixel, 4);
+                continue;
+            }
+            // straight alpha over, weight of what is already there
+            uint32_t keep = div255(d[3] * (255 - alpha));
+            uint32_t total = alpha + keep;
+            d[0] = (pixel[0] * alpha + d[0] * keep + total / 2) / total;
+            d[1] = (pixel[1] * alpha + d[1] * keep + total / 2) / total;
+            d[2] = (pixel[2] * alpha + d[2] * keep + total / 2) / total;
+            d[3] = total;
+        }
+    }
+};
+
 #if USE_OPENGL
 // glfw callbacks
 void glfwErrorCallback(int error, const char* description);
@@ -174,116 +355,2070 @@ void main() {                                       \n\
 }";
 #endif
 
-class R2DEngine {
-private:
-    // game
-    bool loop;
+class R2DEngine {
+private:
+    // game
+    bool loop;
+
+    // graphics
+#if USE_OPENGL
+    GLFWwindow* window;
+    GLuint bufferTexture;
+    GLubyte* bufferData;
+    GLuint vao, ibo, vbo;
+#elif USE_SDL2
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    SDL_Texture* bufferTexture;
+    uint8_t* bufferData;
+#endif
+
+    // events
+#if USE_SDL2
+    SDL_Event event;
+#endif
+
+protected:
+    // game
+    struct Coord {
+        uint32_t x = 0;
+        uint32_t y = 0;
+        Coord(uint32_t x = 0, uint32_t y = 0) : x(x), y(y) {}
+    };
+
+    struct Color {
+        uint8_t r = 0;
+        uint8_t g = 0;
+        uint8_t b = 0;
+        uint8_t a = 255;
+        Color(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t a = 255) : r(r), g(g), b(b), a(a) {}
+    };
+
+    // threads
+    class ThreadPool {
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stop;
+
+        void workerLoop();
+
+    public:
+        ThreadPool(size_t workerCount = std::thread::hardware_concurrency());
+        ~ThreadPool();
+
+        size_t size() const;
+        void enqueue(std::function<void()> task);
+        // splits [begin, end) into bands and runs body(bandBegin, bandEnd) on the
+        // workers and the calling thread, returns once every band is done.
+        // must not be called from inside a pool task
+        void parallelFor(int32_t begin, int32_t end, const std::function<void(int32_t, int32_t)>& body);
+    };
+
+    // cpu shaders
+    static constexpr int32_t SHADER_BATCH_SIZE = 8;
+
+    struct ShaderUniforms {
+        double time = 0.0;
+        int32_t innerWidth = 0;
+        int32_t innerHeight = 0;
+        std::array<float, 16> values = {};
+    };
+
+    // color holds the current pixel of bufferData and is written back
+    using PixelShader = std::function<void(int32_t x, int32_t y, const ShaderUniforms& uniforms, Color& color)>;
+    // row points at the first of innerWidth RGBA pixels of row y
+    using RowShader = std::function<void(int32_t y, uint8_t* row, const ShaderUniforms& uniforms)>;
+    // SHADER_BATCH_SIZE pixels of one row split by channel, values are 0..1.
+    // lanes at or past count are padding and are discarded
+    struct ShaderBatch {
+        int32_t x = 0;
+        int32_t y = 0;
+        int32_t count = 0;
+        alignas(16) float r[SHADER_BATCH_SIZE];
+        alignas(16) float g[SHADER_BATCH_SIZE];
+        alignas(16) float b[SHADER_BATCH_SIZE];
+        alignas(16) float a[SHADER_BATCH_SIZE];
+    };
+
+    // batch holds the pixels x .. x + count of row y and is written back
+    using BatchShader = std::function<void(ShaderBatch& batch, const ShaderUniforms& uniforms)>;
+
+    // images
+    struct Image {
+        int32_t width = 0;
+        int32_t height = 0;
+        // RGBA, width * height * 4 bytes
+        std::shared_ptr<uint8_t> pixels;
+
+        Image(int32_t width = 0, int32_t height = 0);
+        uint8_t* data() const {
+            return pixels.get();
+        }
+    };
+
+    // tiles
+    class TileMap {
+    public:
+        static constexpr int32_t EMPTY_TILE = -1;
+
+    private:
+        struct Chunk {
+            std::vector<uint8_t> pixels;
+            bool dirty = true;
+            uint64_t lastFrame = 0;
+            std::list<uint64_t>::iterator lru;
+        };
+
+        Image tileset;
+        int32_t tileWidth;
+        int32_t tileHeight;
+        int32_t tilesetColumns;
+        int32_t tileCount;
+
+        int32_t mapWidth;
+        int32_t mapHeight;
+        std::vector<int32_t> tiles;
+
+        int32_t chunkTiles;
+        int32_t chunkWidth;
+        int32_t chunkHeight;
+        size_t memoryBudget;
+        size_t cachedBytes;
+        std::unordered_map<uint64_t, Chunk> chunks;
+        // most recently drawn chunk keys first
+        std::list<uint64_t> lru;
+
+        uint64_t chunkKey(int32_t chunkX, int32_t chunkY) const;
+        Chunk& fetchChunk(int32_t chunkX, int32_t chunkY, uint64_t frame);
+        void renderChunk(int32_t chunkX, int32_t chunkY, Chunk& chunk);
+        void evictChunks(uint64_t frame);
+
+    public:
+        // tileset is cut into tileWidth x tileHeight tiles numbered row by row,
+        // the map is mapWidth x mapHeight tiles and is cached in chunks of
+        // chunkTiles x chunkTiles tiles, least recently drawn chunks are dropped
+        // once the cache grows past memoryBudget bytes
+        TileMap(const Image& tileset, int32_t tileWidth, int32_t tileHeight, int32_t mapWidth, int32_t mapHeight, int32_t chunkTiles = 16, size_t memoryBudget = 64 * 1024 * 1024);
+
+        int32_t getTile(int32_t x, int32_t y) const;
+        void setTile(int32_t x, int32_t y, int32_t tile);
+        // grid holds mapWidth * mapHeight tile ids row by row
+        void setTiles(const std::vector<int32_t>& grid);
+
+        int32_t getMapWidth() const;
+        int32_t getMapHeight() const;
+        int32_t getTileWidth() const;
+        int32_t getTileHeight() const;
+        size_t getCachedBytes() const;
+
+        // copies the visible part of the map into an RGBA target, map pixel
+        // (scrollX, scrollY) lands on target pixel (0, 0). chunks drawn with
+        // the current frame id are never evicted, so drawing the map several
+        // times in one frame keeps all of them
+        void draw(uint8_t* target, int32_t targetWidth, int32_t targetHeight, int32_t scrollX, int32_t scrollY, uint64_t frame);
+    };
+
+    // layers
+    class Layer {
+    private:
+        friend class R2DEngine;
+
+        std::string name;
+        int32_t z;
+        uint8_t opacity;
+        bool visible;
+        bool persistent;
+
+        int32_t width;
+        int32_t height;
+        std::vector<uint8_t> pixels;
+        // per row [left, right) spans, empty when left >= right.
+        // dirty is what changed since the last composite, used is
+        // everything drawn since the layer was last cleared
+        std::vector<int32_t> dirtyLeft;
+        std::vector<int32_t> dirtyRight;
+        std::vector<int32_t> usedLeft;
+        std::vector<int32_t> usedRight;
+
+        void markUsedDirty();
+        void beginFrame();
+
+    public:
+        // persistent layers keep their pixels across frames, the others
+        // are wiped before every onUpdate
+        Layer(const std::string& name, int32_t width, int32_t height, int32_t z = 0, bool persistent = true);
+
+        const std::string& getName() const;
+        int32_t getZ() const;
+        float getOpacity() const;
+        bool isVisible() const;
+        void setZ(int32_t z);
+        void setOpacity(float opacity);
+        void setVisible(bool visible);
+
+        // RGBA, call markDirty after writing through it
+        uint8_t* data();
+        void markDirty(int32_t x, int32_t y, int32_t w, int32_t h);
+
+        void clear();
+        void fill(Color color);
+        void drawPoint(Coord coord, Color color);
+        void drawImage(Coord coord, const Image& image);
+    };
+
+    // post processing
+    class PostEffect {
+    private:
+        friend class R2DEngine;
+        // milliseconds spent in the last apply
+        double time = 0.0;
+
+    public:
+        virtual ~PostEffect() {}
+        virtual const char* getName() const = 0;
+        // src and dst are width x height RGBA and never overlap
+        virtual void apply(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height, ThreadPool& pool) = 0;
+        double getTime() const {
+            return time;
+        }
+    };
+
+    // separable blur, weights are fixed point with 1.0 at BLUR_ONE
+    class GaussianBlur : public PostEffect {
+    private:
+        static constexpr int32_t BLUR_SHIFT = 14;
+        static constexpr int32_t BLUR_ONE = 1 << BLUR_SHIFT;
+
+        float sigma;
+        int32_t radius;
+        std::vector<int16_t> weights;
+        std::vector<uint8_t> temp;
+
+        // acc[i] += weight0 * tap0[i] + weight1 * tap1[i], taps go in pairs
+        // so SSE2 can multiply and add both with one madd
+        static void accumulate(int32_t* acc, const uint8_t* tap0, const uint8_t* tap1, int16_t weight0, int16_t weight1, int32_t count);
+        // out[i] = acc[i] / BLUR_ONE rounded
+        static void resolve(uint8_t* out, const int32_t* acc, int32_t count);
+
+    public:
+        GaussianBlur(float sigma = 2.0f);
+        void setSigma(float sigma);
+        float getSigma() const;
+        const char* getName() const override;
+        void apply(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height, ThreadPool& pool) override;
+    };
+
+    // adds a blurred copy of the pixels brighter than threshold, the bright
+    // pass is taken and blurred at half resolution
+    class Bloom : public PostEffect {
+    private:
+        uint8_t threshold;
+        uint16_t intensity;
+        GaussianBlur blur;
+        std::vector<uint8_t> bright;
+        std::vector<uint8_t> blurred;
+        // blurred rows upsampled to full width
+        std::vector<uint8_t> wide;
+
+        // out gets width / 2 rounded up pixels, each the 2x2 average of
+        // row0 and row1 if its luma is above threshold, else black
+        static void brightPass(uint8_t* out, const uint8_t* row0, const uint8_t* row1, int32_t width, uint8_t threshold);
+        // out gets count * 2 pixels, in holds count pixels with one
+        // repeated edge pixel on each side
+        static void expand(uint8_t* out, const uint8_t* in, int32_t count);
+        // out[i] = in[i] + 3/4 near + 1/4 far scaled by intensity, saturated
+        static void combine(uint8_t* out, const uint8_t* in, const uint8_t* near, const uint8_t* far, uint16_t intensity, int32_t count);
+
+    public:
+        Bloom(uint8_t threshold = 200, float intensity = 1.0f, float sigma = 6.0f);
+        const char* getName() const override;
+        void apply(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height, ThreadPool& pool) override;
+    };
+
+    // size x size x size RGB lookup table with trilinear filtering, starts as identity
+    class ColorGrade : public PostEffect {
+    private:
+        int32_t size;
+        // RGB plus a padding byte per entry so an entry loads as one word,
+        // red varies fastest, then green, then blue
+        std::vector<uint8_t> table;
+        std::array<int32_t, 256> index;
+        std::array<int32_t, 256> fraction;
+
+        void buildIndex();
+
+    public:
+        ColorGrade(int32_t size = 17);
+        void bake(const std::function<Color(Color)>& grade);
+        // reads an Adobe .cube 3D LUT
+        bool loadCube(const char* path);
+        const char* getName() const override;
+        void apply(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height, ThreadPool& pool) override;
+    };
+
+    // darkened odd rows, RGB aperture mask and vignette
+    class Crt : public PostEffect {
+    private:
+        float scanline;
+        float mask;
+        float vignette;
+        int32_t cachedWidth;
+        int32_t cachedHeight;
+        // factors per row and per column channel, 32768 is 1.0
+        std::vector<uint16_t> rowScale;
+        std::vector<uint16_t> columnScale;
+
+    public:
+        Crt(float scanline = 0.3f, float mask = 0.15f, float vignette = 0.3f);
+        const char* getName() const override;
+        void apply(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height, ThreadPool& pool) override;
+    };
+
+    // vector paths
+    enum FillRule {
+        NONZERO,
+        EVENODD
+    };
+
+    enum LineCap {
+        BUTT,
+        ROUND,
+        SQUARE
+    };
+
+    // curves are flattened into polylines as they are added
+    class Path {
+    private:
+        friend class R2DEngine;
+
+        struct Point {
+            float x;
+            float y;
+        };
+
+        struct Contour {
+            std::vector<Point> points;
+            bool closed = false;
+        };
+
+        // max distance in pixels between a curve and its polyline
+        float tolerance;
+        std::vector<Contour> contours;
+
+        // end of the last contour, or its start once it is closed
+        Point current() const;
+
+    public:
+        Path(float tolerance = 0.05f);
+
+        Path& moveTo(float x, float y);
+        Path& lineTo(float x, float y);
+        Path& quadTo(float cx, float cy, float x, float y);
+        Path& cubicTo(float c1x, float c1y, float c2x, float c2y, float x, float y);
+        // segments added after close start a new contour at the closed one's start
+        Path& close();
+
+        Path& addRect(float x, float y, float w, float h);
+        Path& addEllipse(float cx, float cy, float rx, float ry);
+        Path& addCircle(float cx, float cy, float r);
+
+        void clear();
+        bool empty() const;
+    };
+
+    // assets
+    using ImageHandle = std::shared_future<Image>;
+
+    class AssetManager {
+    private:
+        // identifies one version of a source file without reading it
+        struct SourceKey {
+            uint64_t hash;
+            uint64_t size;
+            int64_t time;
+        };
+
+        // cache file layout: header padded to CACHE_HEADER_SIZE bytes, then RGBA pixels
+        struct CacheHeader {
+            char magic[4];
+            uint32_t version;
+            uint64_t hash;
+            uint64_t sourceSize;
+            int64_t sourceTime;
+            int32_t width;
+            int32_t height;
+        };
+        static constexpr char CACHE_MAGIC[4] = {'R', '2', 'D', 'C'};
+        static constexpr uint32_t CACHE_VERSION = 2;
+        static constexpr size_t CACHE_HEADER_SIZE = 64;
+
+        std::string cacheDirectory;
+        size_t workerCount;
+        bool imageInitialized;
+        // set while shutting down, queued loads then resolve without decoding
+        std::atomic<bool> cancelled;
+        std::mutex mutex;
+        std::map<std::string, ImageHandle> images;
+        // started by the first loadImage, declared last so pending loads
+        // finish before the members they use go away
+        std::unique_ptr<ThreadPool> workers;
+
+        Image decodeImage(const std::string& path);
+        static bool headerMatches(const CacheHeader& header, const SourceKey& key);
+        std::string cachePath(const SourceKey& key) const;
+        Image readCache(const SourceKey& key);
+        void writeCache(const SourceKey& key, const Image& image);
+
+    public:
+        // decoded RGBA pixels are cached under cacheDirectory keyed by the
+        // source path, size and modification time, an empty cacheDirectory
+        // disables the disk cache. no threads are started until the first load
+        AssetManager(size_t workerCount = std::thread::hardware_concurrency(), const std::string& cacheDirectory = ".r2dcache");
+        ~AssetManager();
+
+        // owns SDL_image: waits for the decodes in progress, resolves queued
+        // loads to empty images, joins the workers and quits SDL_image.
+        // forgets every handle, a later loadImage starts over
+        void shutdown();
+
+        // decodes on a worker, loading the same path again shares the handle.
+        // a failed load yields an empty image
+        ImageHandle loadImage(const std::string& path);
+        void release(const std::string& path);
+        static bool isReady(const ImageHandle& handle);
+    };
+
+    // graphics
+    int32_t screenWidth;
+    int32_t screenHeight;
+    int32_t innerWidth;
+    int32_t innerHeight;
+    std::string windowTitle;
+#if USE_OPENGL
+    GLuint shader;
+#endif
+    ShaderUniforms uniforms;
+    AssetManager assets;
+    // shared by layers, shaders and post effects, started on first use.
+    // call from the game loop thread only
+    ThreadPool& getThreadPool();
+
+    // events
+    enum InputState {
+        UNKNOWN,
+        PRESS,
+        RELEASE,
+        REPEAT
+    };
+    double mousePosX;
+    double mousePosY;
+    
+private:
+    // cpu shaders
+    PixelShader pixelShader;
+    RowShader rowShader;
+    BatchShader batchShader;
+
+    // advanced once per game loop iteration
+    uint64_t frameCount;
+
+    // started by the first getThreadPool
+    std::unique_ptr<ThreadPool> threadPool;
+
+    // layers, sorted by z when composited
+    std::vector<std::unique_ptr<Layer>> layers;
+    Layer* baseLayer;
+    std::vector<int32_t> damageLeft;
+    std::vector<int32_t> damageRight;
+    int32_t uploadTop;
+    int32_t uploadBottom;
+
+    // post processing, ping-pongs between postBuffers and leaves the
+    // final frame in presentData without touching bufferData
+    std::vector<std::unique_ptr<PostEffect>> postEffects;
+    std::vector<uint8_t> postBuffers[2];
+    uint8_t* presentData;
+
+    // sparse scanline coverage accumulator, every row keeps the cells an
+    // edge crossed with their signed area, a running sum over the sorted
+    // cells gives the coverage for the cell and the run after it. the sum
+    // is exact for simple outlines, where outlines overlap it is the
+    // winding averaged over the pixel clamped to 1, so pixels holding
+    // edges of both overlapping parts come out too strong
+    class Rasterizer {
+    private:
+        struct Cell {
+            int32_t x;
+            float area;
+        };
+
+        int32_t width;
+        int32_t height;
+        std::vector<std::vector<Cell>> rows;
+        int32_t top;
+        int32_t bottom;
+
+        static constexpr float STROKE_TOLERANCE = 0.05f;
+
+        void addCell(int32_t y, int32_t x, float area);
+        void addPolygon(const std::vector<Path::Point>& points);
+        void addArc(std::vector<Path::Point>& outline, Path::Point center, float vx, float vy, float sweep, bool includeEnd);
+        void addOffset(std::vector<Path::Point>& outline, const std::vector<Path::Point>& points, bool closed, float half);
+        void addCap(std::vector<Path::Point>& outline, const std::vector<Path::Point>& points, float half, LineCap cap);
+
+    public:
+        // pixel bounds touched by the last render
+        int32_t left;
+        int32_t right;
+        int32_t minY;
+        int32_t maxY;
+
+        Rasterizer();
+        void reset(int32_t width, int32_t height);
+        void addLine(float x0, float y0, float x1, float y1);
+        void addFill(const Path& path);
+        void addStroke(const Path& path, float strokeWidth, LineCap cap);
+        void render(uint8_t* target, Color color, FillRule rule);
+    };
+    Rasterizer rasterizer;
+
+private:
+    void gameLoop();
+
+    void clearBuffer();
+    void compositeLayers();
+    // where draw calls without a layer go, nullptr means bufferData
+    Layer* directLayer();
+    void runShader();
+    void runPostEffects();
+    void swapBuffers();
+
+#if USE_OPENGL
+    std::string importShader(const char* shaderPath);
+    void addShader(GLuint program, const char* shaderCode, GLenum shaderType);
+    void compileShaders(const char* vCode, const char* fCode);
+#endif
+
+public:
+    R2DEngine();
+    virtual ~R2DEngine();
+
+public:
+    // user interfaces
+    virtual bool onCreate() = 0;
+    virtual bool onUpdate(double deltaTime) = 0;
+    virtual bool onDestroy() {
+        return true;
+    }
+
+public:
+    // game
+    bool construct(int32_t screenWidth = 800, int32_t screenHeight = 600, int32_t innerWidth = 800, int32_t innerHeight = 600);
+    void init(const char* vShaderPath = "", const char* fShaderPath = "");
+    // id of the frame being built, starts at 1 with the first onUpdate
+    uint64_t getFrameCount() const;
+
+public:
+    // events
+    InputState getKeyState(int key) const;
+    InputState getMouseState(int mouseButton) const;
+
+
+public:
+    // graphics
+    void drawPoint(Coord coord, Color color);
+    // anti-aliased 1 pixel wide line between pixel centers
+    void drawLine(Coord coord1, Coord coord2, Color color);
+
+    // cpu shaders run over bufferData after onUpdate, only the last one set is used
+    void setPixelShader(PixelShader kernel);
+    void setRowShader(RowShader kernel);
+    void setBatchShader(BatchShader kernel);
+    void clearShader();
+
+    void drawTileMap(TileMap& tileMap, int32_t scrollX, int32_t scrollY);
+    void drawTileMap(Layer& layer, TileMap& tileMap, int32_t scrollX, int32_t scrollY);
+    void drawImage(Coord coord, const Image& image);
+    void drawImage(Layer& layer, Coord coord, const Image& image);
+
+    // once a layer exists bufferData is no longer cleared each frame and is
+    // rebuilt from the layers where they changed. the first layer also adds
+    // a non-persistent BASE_LAYER at z 0 below it, which the draw calls that
+    // take no layer write into from then on
+    static constexpr const char* BASE_LAYER = "base";
+    Layer& createLayer(const std::string& name, int32_t z = 0, bool persistent = true);
+    Layer* getLayer(const std::string& name);
+    void removeLayer(const std::string& name);
+
+    // effects run in the order added, after the cpu shader
+    template <class Effect, class... Args>
+    Effect& addPostEffect(Args&&... args) {
+        Effect* effect = new Effect(std::forward<Args>(args)...);
+        postEffects.emplace_back(effect);
+        return *effect;
+    }
+    void removePostEffect(const PostEffect& effect);
+    void clearPostEffects();
+    // "name time" of every effect in the last frame
+    std::string getPostTimings() const;
+
+    // anti-aliased vector paths in pixel coordinates, pixel centers sit at +0.5
+    void fillPath(const Path& path, Color color, FillRule rule = NONZERO);
+    void strokePath(const Path& path, float width, Color color, LineCap cap = BUTT);
+    void fillPath(Layer& layer, const Path& path, Color color, FillRule rule = NONZERO);
+    void strokePath(Layer& layer, const Path& path, float width, Color color, LineCap cap = BUTT);
+};
+
+#if USE_OPENGL
+void glfwErrorCallback(int error, const char* description) {
+    DEBUG_MSG(description);
+}
+
+void glfwFramebufferSizeCallback(GLFWwindow* window, int screenWidth, int screenHeight) {
+    glViewport(0, 0, screenWidth, screenHeight);
+}
+#endif
+
+R2DEngine::ThreadPool::ThreadPool(size_t workerCount) {
+    stop = false;
+    for (size_t i = 0; i < workerCount; i ++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+R2DEngine::ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stop = true;
+    }
+    condition.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void R2DEngine::ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stop || !tasks.empty(); });
+            if (stop && tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+size_t R2DEngine::ThreadPool::size() const {
+    return workers.size();
+}
+
+void R2DEngine::ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+    }
+    condition.notify_one();
+}
+
+void R2DEngine::ThreadPool::parallelFor(int32_t begin, int32_t end, const std::function<void(int32_t, int32_t)>& body) {
+    int32_t count = end - begin;
+    if (count <= 0) {
+        return;
+    }
+    // a few bands per thread so uneven rows balance out
+    int32_t bands = std::min<int32_t>(count, static_cast<int32_t>(workers.size() + 1) * 4);
+    if (workers.empty() || bands == 1) {
+        body(begin, end);
+        return;
+    }
+
+    struct Job {
+        std::atomic<int32_t> next;
+        int32_t pending;
+        std::mutex mutex;
+        std::condition_variable done;
+    } job;
+    job.next = 0;
+    job.pending = static_cast<int32_t>(std::min<size_t>(workers.size(), bands - 1));
+
+    auto run = [&]() {
+        int32_t band;
+        while ((band = job.next.fetch_add(1)) < bands) {
+            body(begin + static_cast<int64_t>(count) * band / bands, begin + static_cast<int64_t>(count) * (band + 1) / bands);
+        }
+    };
+
+    int32_t helpers = job.pending;
+    for (int32_t i = 0; i < helpers; i ++) {
+        enqueue([&job, &run]() {
+            run();
+            std::unique_lock<std::mutex> lock(job.mutex);
+            if (--job.pending == 0) {
+                job.done.notify_one();
+            }
+        });
+    }
+    run();
+
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.done.wait(lock, [&job] { return job.pending == 0; });
+}
+
+R2DEngine::Image::Image(int32_t width, int32_t height) : width(width), height(height) {
+    if (width > 0 && height > 0) {
+        pixels = std::shared_ptr<uint8_t>(new uint8_t[width * height * 4](), std::default_delete<uint8_t[]>());
+    }
+}
+
+R2DEngine::TileMap::TileMap(const Image& tileset, int32_t tileWidth, int32_t tileHeight, int32_t mapWidth, int32_t mapHeight, int32_t chunkTiles, size_t memoryBudget)
+    : tileset(tileset), tileWidth(std::max(tileWidth, 1)), tileHeight(std::max(tileHeight, 1)), mapWidth(std::max(mapWidth, 0)), mapHeight(std::max(mapHeight, 0)), chunkTiles(std::max(chunkTiles, 1)), memoryBudget(memoryBudget) {
+    // sizes are divisors below, release builds clamp them instead
+    ASSERT(tileWidth > 0 && tileHeight > 0);
+    ASSERT(mapWidth >= 0 && mapHeight >= 0);
+    ASSERT(chunkTiles > 0);
+    tilesetColumns = this->tileset.width / this->tileWidth;
+    tileCount = tilesetColumns * (this->tileset.height / this->tileHeight);
+    tiles.assign(this->mapWidth * this->mapHeight, EMPTY_TILE);
+    chunkWidth = this->chunkTiles * this->tileWidth;
+    chunkHeight = this->chunkTiles * this->tileHeight;
+    cachedBytes = 0;
+}
+
+uint64_t R2DEngine::TileMap::chunkKey(int32_t chunkX, int32_t chunkY) const {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(chunkY)) << 32) | static_cast<uint32_t>(chunkX);
+}
+
+int32_t R2DEngine::TileMap::getTile(int32_t x, int32_t y) const {
+    if (x < 0 || x >= mapWidth || y < 0 || y >= mapHeight) {
+        return EMPTY_TILE;
+    }
+    return tiles[y * mapWidth + x];
+}
+
+void R2DEngine::TileMap::setTile(int32_t x, int32_t y, int32_t tile) {
+    if (x < 0 || x >= mapWidth || y < 0 || y >= mapHeight || tiles[y * mapWidth + x] == tile) {
+        return;
+    }
+    tiles[y * mapWidth + x] = tile;
+    auto it = chunks.find(chunkKey(x / chunkTiles, y / chunkTiles));
+    if (it != chunks.end()) {
+        it->second.dirty = true;
+    }
+}
+
+void R2DEngine::TileMap::setTiles(const std::vector<int32_t>& grid) {
+    ASSERT(grid.size() == tiles.size());
+    for (int32_t y = 0; y < mapHeight; y ++) {
+        for (int32_t x = 0; x < mapWidth; x ++) {
+            setTile(x, y, grid[y * mapWidth + x]);
+        }
+    }
+}
+
+int32_t R2DEngine::TileMap::getMapWidth() const {
+    return mapWidth;
+}
+
+int32_t R2DEngine::TileMap::getMapHeight() const {
+    return mapHeight;
+}
+
+int32_t R2DEngine::TileMap::getTileWidth() const {
+    return tileWidth;
+}
+
+int32_t R2DEngine::TileMap::getTileHeight() const {
+    return tileHeight;
+}
+
+size_t R2DEngine::TileMap::getCachedBytes() const {
+    return cachedBytes;
+}
+
+R2DEngine::TileMap::Chunk& R2DEngine::TileMap::fetchChunk(int32_t chunkX, int32_t chunkY, uint64_t frame) {
+    uint64_t key = chunkKey(chunkX, chunkY);
+    auto it = chunks.find(key);
+    if (it == chunks.end()) {
+        it = chunks.emplace(key, Chunk()).first;
+        it->second.pixels.resize(chunkWidth * chunkHeight * 4);
+        lru.push_front(key);
+        it->second.lru = lru.begin();
+        cachedBytes += it->second.pixels.size();
+    } else {
+        lru.splice(lru.begin(), lru, it->second.lru);
+    }
+    Chunk& chunk = it->second;
+    chunk.lastFrame = frame;
+    if (chunk.dirty) {
+        renderChunk(chunkX, chunkY, chunk);
+        chunk.dirty = false;
+    }
+    return chunk;
+}
+
+void R2DEngine::TileMap::renderChunk(int32_t chunkX, int32_t chunkY, Chunk& chunk) {
+    const uint8_t* source = tileset.data();
+    int32_t rowBytes = tileWidth * 4;
+    for (int32_t ty = 0; ty < chunkTiles; ty ++) {
+        for (int32_t tx = 0; tx < chunkTiles; tx ++) {
+            int32_t tile = getTile(chunkX * chunkTiles + tx, chunkY * chunkTiles + ty);
+            uint8_t* dst = chunk.pixels.data() + (ty * tileHeight * chunkWidth + tx * tileWidth) * 4;
+            if (tile < 0 || tile >= tileCount) {
+                for (int32_t y = 0; y < tileHeight; y ++) {
+                    memset(dst + y * chunkWidth * 4, 0, rowBytes);
+                }
+                continue;
+            }
+            const uint8_t* src = source + ((tile / tilesetColumns) * tileHeight * tileset.width + (tile % tilesetColumns) * tileWidth) * 4;
+            for (int32_t y = 0; y < tileHeight; y ++) {
+                memcpy(dst + y * chunkWidth * 4, src + y * tileset.width * 4, rowBytes);
+            }
+        }
+    }
+}
+
+void R2DEngine::TileMap::evictChunks(uint64_t frame) {
+    // chunks drawn this frame stay even if they alone exceed the budget
+    while (cachedBytes > memoryBudget && !lru.empty()) {
+        auto it = chunks.find(lru.back());
+        if (it->second.lastFrame == frame) {
+            break;
+        }
+        cachedBytes -= it->second.pixels.size();
+        chunks.erase(it);
+        lru.pop_back();
+    }
+}
+
+void R2DEngine::TileMap::draw(uint8_t* target, int32_t targetWidth, int32_t targetHeight, int32_t scrollX, int32_t scrollY, uint64_t frame) {
+    // visible map pixels, clipped to the map
+    int32_t left = std::max(scrollX, 0);
+    int32_t top = std::max(scrollY, 0);
+    int32_t right = std::min(scrollX + targetWidth, mapWidth * tileWidth);
+    int32_t bottom = std::min(scrollY + targetHeight, mapHeight * tileHeight);
+    if (left >= right || top >= bottom) {
+        return;
+    }
+
+    for (int32_t chunkY = top / chunkHeight; chunkY <= (bottom - 1) / chunkHeight; chunkY ++) {
+        for (int32_t chunkX = left / chunkWidth; chunkX <= (right - 1) / chunkWidth; chunkX ++) {
+            const Chunk& chunk = fetchChunk(chunkX, chunkY, frame);
+
+            int32_t x0 = std::max(left, chunkX * chunkWidth);
+            int32_t x1 = std::min(right, (chunkX + 1) * chunkWidth);
+            int32_t y0 = std::max(top, chunkY * chunkHeight);
+            int32_t y1 = std::min(bottom, (chunkY + 1) * chunkHeight);
+            size_t rowBytes = (x1 - x0) * 4;
+            for (int32_t y = y0; y < y1; y ++) {
+                const uint8_t* src = chunk.pixels.data() + ((y - chunkY * chunkHeight) * chunkWidth + (x0 - chunkX * chunkWidth)) * 4;
+                memcpy(target + ((y - scrollY) * targetWidth + (x0 - scrollX)) * 4, src, rowBytes);
+            }
+        }
+    }
+
+    evictChunks(frame);
+}
+
+R2DEngine::Layer::Layer(const std::string& name, int32_t width, int32_t height, int32_t z, bool persistent)
+    : name(name), z(z), opacity(255), visible(true), persistent(persistent), width(width), height(height) {
+    pixels.assign(width * height * 4, 0);
+    dirtyLeft.assign(height, width);
+    dirtyRight.assign(height, 0);
+    usedLeft.assign(height, width);
+    usedRight.assign(height, 0);
+}
+
+const std::string& R2DEngine::Layer::getName() const {
+    return name;
+}
+
+int32_t R2DEngine::Layer::getZ() const {
+    return z;
+}
+
+float R2DEngine::Layer::getOpacity() const {
+    return opacity / 255.0f;
+}
+
+bool R2DEngine::Layer::isVisible() const {
+    return visible;
+}
+
+void R2DEngine::Layer::setZ(int32_t z) {
+    if (this->z != z) {
+        this->z = z;
+        markUsedDirty();
+    }
+}
+
+void R2DEngine::Layer::setOpacity(float opacity) {
+    uint8_t value = static_cast<uint8_t>(std::round(std::min(std::max(opacity, 0.0f), 1.0f) * 255.0f));
+    if (this->opacity != value) {
+        this->opacity = value;
+        markUsedDirty();
+    }
+}
+
+void R2DEngine::Layer::setVisible(bool visible) {
+    if (this->visible != visible) {
+        this->visible = visible;
+        markUsedDirty();
+    }
+}
+
+uint8_t* R2DEngine::Layer::data() {
+    return pixels.data();
+}
+
+void R2DEngine::Layer::markDirty(int32_t x, int32_t y, int32_t w, int32_t h) {
+    int32_t left = std::max(x, 0);
+    int32_t right = std::min(x + w, width);
+    if (left >= right) {
+        return;
+    }
+    for (int32_t row = std::max(y, 0); row < std::min(y + h, height); row ++) {
+        dirtyLeft[row] = std::min(dirtyLeft[row], left);
+        dirtyRight[row] = std::max(dirtyRight[row], right);
+        usedLeft[row] = std::min(usedLeft[row], left);
+        usedRight[row] = std::max(usedRight[row], right);
+    }
+}
+
+void R2DEngine::Layer::markUsedDirty() {
+    for (int32_t row = 0; row < height; row ++) {
+        dirtyLeft[row] = std::min(dirtyLeft[row], usedLeft[row]);
+        dirtyRight[row] = std::max(dirtyRight[row], usedRight[row]);
+    }
+}
+
+void R2DEngine::Layer::beginFrame() {
+    if (!persistent) {
+        clear();
+    }
+}
+
+void R2DEngine::Layer::clear() {
+    // only what was drawn needs wiping and recompositing
+    for (int32_t row = 0; row < height; row ++) {
+        if (usedLeft[row] < usedRight[row]) {
+            memset(pixels.data() + (row * width + usedLeft[row]) * 4, 0, (usedRight[row] - usedLeft[row]) * 4);
+            dirtyLeft[row] = std::min(dirtyLeft[row], usedLeft[row]);
+            dirtyRight[row] = std::max(dirtyRight[row], usedRight[row]);
+        }
+        usedLeft[row] = width;
+        usedRight[row] = 0;
+    }
+}
+
+void R2DEngine::Layer::fill(Color color) {
+    for (int32_t i = 0; i < width * height; i ++) {
+        memcpy(pixels.data() + i * 4, &color, 4);
+    }
+    markDirty(0, 0, width, height);
+}
+
+void R2DEngine::Layer::drawPoint(Coord coord, Color color) {
+    if (coord.x < static_cast<uint32_t>(width) && coord.y < static_cast<uint32_t>(height)) {
+        memcpy(pixels.data() + (coord.y * width + coord.x) * 4, &color, 4);
+        markDirty(coord.x, coord.y, 1, 1);
+    }
+}
+
+void R2DEngine::Layer::drawImage(Coord coord, const Image& image) {
+    if (!image.data() || coord.x >= static_cast<uint32_t>(width) || coord.y >= static_cast<uint32_t>(height)) {
+        return;
+    }
+    int32_t w = std::min<int32_t>(image.width, width - coord.x);
+    int32_t h = std::min<int32_t>(image.height, height - coord.y);
+    for (int32_t y = 0; y < h; y ++) {
+        memcpy(pixels.data() + ((coord.y + y) * width + coord.x) * 4, image.data() + y * image.width * 4, w * 4);
+    }
+    markDirty(coord.x, coord.y, w, h);
+}
+
+R2DEngine::GaussianBlur::GaussianBlur(float sigma) {
+    setSigma(sigma);
+}
+
+void R2DEngine::GaussianBlur::setSigma(float sigma) {
+    this->sigma = std::max(sigma, 0.1f);
+    radius = std::max(1, static_cast<int32_t>(std::ceil(this->sigma * 3.0f)));
+
+    std::vector<float> kernel(radius * 2 + 1);
+    float sum = 0.0f;
+    for (int32_t k = -radius; k <= radius; k ++) {
+        kernel[k + radius] = std::exp(-(k * k) / (2.0f * this->sigma * this->sigma));
+        sum += kernel[k + radius];
+    }
+    // weights add up to exactly BLUR_ONE, the units lost to rounding down
+    // go to the taps that lost the most so wide kernels keep their shape
+    weights.resize(kernel.size());
+    std::vector<std::pair<float, size_t>> remainders(kernel.size());
+    int32_t total = 0;
+    for (size_t k = 0; k < kernel.size(); k ++) {
+        float exact = kernel[k] / sum * BLUR_ONE;
+        weights[k] = static_cast<int16_t>(std::floor(exact));
+        remainders[k] = {exact - weights[k], k};
+        total += weights[k];
+    }
+    std::stable_sort(remainders.begin(), remainders.end(), [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) {
+        return a.first > b.first;
+    });
+    for (int32_t i = 0; total < BLUR_ONE; i ++, total ++) {
+        weights[remainders[i % remainders.size()].second] ++;
+    }
+}
+
+float R2DEngine::GaussianBlur::getSigma() const {
+    return sigma;
+}
+
+const char* R2DEngine::GaussianBlur::getName() const {
+    return "blur";
+}
+
+void R2DEngine::GaussianBlur::accumulate(int32_t* acc, const uint8_t* tap0, const uint8_t* tap1, int16_t weight0, int16_t weight1, int32_t count) {
+    int32_t i = 0;
+#if R2D_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi32(static_cast<int32_t>((static_cast<uint32_t>(static_cast<uint16_t>(weight1)) << 16) | static_cast<uint16_t>(weight0)));
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tap0 + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tap1 + i));
+        // 16 bit (tap0, tap1) pairs, madd gives tap0 * weight0 + tap1 * weight1 per byte
+        __m128i lo = _mm_unpacklo_epi8(a, b);
+        __m128i hi = _mm_unpackhi_epi8(a, b);
+        __m128i* out = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(out + 0, _mm_add_epi32(_mm_loadu_si128(out + 0), _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w)));
+        _mm_storeu_si128(out + 1, _mm_add_epi32(_mm_loadu_si128(out + 1), _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w)));
+        _mm_storeu_si128(out + 2, _mm_add_epi32(_mm_loadu_si128(out + 2), _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w)));
+        _mm_storeu_si128(out + 3, _mm_add_epi32(_mm_loadu_si128(out + 3), _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w)));
+    }
+#endif
+    for (; i < count; i ++) {
+        acc[i] += weight0 * tap0[i] + weight1 * tap1[i];
+    }
+}
+
+void R2DEngine::GaussianBlur::resolve(uint8_t* out, const int32_t* acc, int32_t count) {
+    int32_t i = 0;
+#if R2D_SSE2
+    const __m128i half = _mm_set1_epi32(BLUR_ONE / 2);
+    for (; i + 16 <= count; i += 16) {
+        const __m128i* in = reinterpret_cast<const __m128i*>(acc + i);
+        __m128i a = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(in + 0), half), BLUR_SHIFT);
+        __m128i b = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(in + 1), half), BLUR_SHIFT);
+        __m128i c = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(in + 2), half), BLUR_SHIFT);
+        __m128i d = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(in + 3), half), BLUR_SHIFT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+#endif
+    for (; i < count; i ++) {
+        out[i] = static_cast<uint8_t>(std::min((acc[i] + BLUR_ONE / 2) >> BLUR_SHIFT, 255));
+    }
+}
+
+void R2DEngine::GaussianBlur::apply(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height, ThreadPool& pool) {
+    temp.resize(width * height * 4);
+    int32_t rowSize = width * 4;
+
+    pool.parallelFor(0, height, [&](int32_t begin, int32_t end) {
+        static thread_local std::vector<uint8_t> padded;
+        static thread_local std::vector<int32_t> acc;
+        padded.resize((width + radius * 2) * 4);
+        acc.resize(rowSize);
+        for (int32_t y = begin; y < end; y ++) {
+            const uint8_t* row = src + y * rowSize;
+            memcpy(padded.data() + radius * 4, row, rowSize);
+            for (int32_t k = 0; k < radius; k ++) {
+                memcpy(padded.data() + k * 4, row, 4);
+                memcpy(padded.data() + (radius + width + k) * 4, row + rowSize - 4, 4);
+            }
+            std::fill(acc.begin(), acc.end(), 0);
+            for (int32_t k = 0; k <= radius * 2; k += 2) {
+                // the odd last tap pairs with itself at weight 0
+                int32_t next = std::min(k + 1, radius * 2);
+                accumulate(acc.data(), padded.data() + k * 4, padded.data() + next * 4, weights[k], next > k ? weights[next] : 0, rowSize);
+            }
+            resolve(temp.data() + y * rowSize, acc.data(), rowSize);
+        }
+    });
+
+    pool.parallelFor(0, height, [&](int32_t begin, int32_t end) {
+        static thread_local std::vector<int32_t> acc;
+        acc.resize(rowSize);
+        for (int32_t y = begin; y < end; y ++) {
+            std::fill(acc.begin(), acc.end(), 0);
+            for (int32_t k = 0; k <= radius * 2; k += 2) {
+                int32_t next = std::min(k + 1, radius * 2);
+                const uint8_t* row0 = temp.data() + std::min(std::max(y + k - radius, 0), height - 1) * rowSize;
+                const uint8_t* row1 = temp.data() + std::min(std::max(y + next - radius, 0), height - 1) * rowSize;
+                accumulate(acc.data(), row0, row1, weights[k], next > k ? weights[next] : 0, rowSize);
+            }
+            resolve(dst + y * rowSize, acc.data(), rowSize);
+        }
+    });
+}
+
+R2DEngine::Bloom::Bloom(uint8_t threshold, float intensity, float sigma) : threshold(threshold), blur(sigma * 0.5f) {
+    this->intensity = static_cast<uint16_t>(std::round(std::min(std::max(intensity, 0.0f), 64.0f) * 256.0f));
+}
+
+const char* R2DEngine::Bloom::getName() const {
+    return "bloom";
+}
+
+void R2DEngine::Bloom::brightPass(uint8_t* out, const uint8_t* row0, const uint8_t* row1, int32_t width, uint8_t threshold) {
+    int32_t x = 0;
+#if R2D_SSE2
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+    const __m128i limit = _mm_set1_epi32(threshold);
+    for (; x + 4 <= width / 2; x += 4) {
+        __m128i a = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8)));
+        __m128i b = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 16)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16)));
+        // even pixels in the low halves, odd pixels in the high halves
+        a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i p = _mm_avg_epu8(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+
+        // channels are below 256 so the 16 bit products fit the low half of each lane
+        __m128i luma = _mm_mullo_epi16(_mm_and_si128(p, byteMask), _mm_set1_epi32(54));
+        luma = _mm_add_epi32(luma, _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(p, 8), byteMask), _mm_set1_epi32(183)));
+        luma = _mm_add_epi32(luma, _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(p, 16), byteMask), _mm_set1_epi32(19)));
+        __m128i keep = _mm_cmpgt_epi32(_mm_srli_epi32(luma, 8), limit);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_and_si128(p, _mm_and_si128(keep, rgbMask)));
+    }
+#endif
+    for (; x < (width + 1) / 2; x ++) {
+        const uint8_t* a0 = row0 + x * 8;
+        const uint8_t* b0 = row1 + x * 8;
+        // an odd width repeats the last column
+        int32_t next = x * 2 + 1 < width ? 4 : 0;
+        uint8_t p[3];
+        for (int32_t c = 0; c < 3; c ++) {
+            p[c] = (((a0[c] + b0[c] + 1) >> 1) + ((a0[c + next] + b0[c + next] + 1) >> 1) + 1) >> 1;
+        }
+        uint8_t keep = (p[0] * 54 + p[1] * 183 + p[2] * 19) >> 8 > threshold ? 255 : 0;
+        out[x * 4 + 0] = p[0] & keep;
+        out[x * 4 + 1] = p[1] & keep;
+        out[x * 4 + 2] = p[2] & keep;
+        out[x * 4 + 3] = 0;
+    }
+}
+
+void R2DEngine::Bloom::expand(uint8_t* out, const uint8_t* in, int32_t count) {
+    // output pixels sit a quarter pixel left and right of each input pixel
+    int32_t x = 0;
+#if R2D_SSE2
+    for (; x + 4 <= count; x += 4) {
+        __m128i center = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x * 4 + 4));
+        __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x * 4));
+        __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x * 4 + 8));
+        __m128i even = _mm_avg_epu8(center, _mm_avg_epu8(center, left));
+        __m128i odd = _mm_avg_epu8(center, _mm_avg_epu8(center, right));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 8), _mm_unpacklo_epi32(even, odd));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 8 + 16), _mm_unpackhi_epi32(even, odd));
+    }
+#endif
+    for (; x < count; x ++) {
+        const uint8_t* center = in + x * 4 + 4;
+        for (int32_t c = 0; c < 4; c ++) {
+            out[x * 8 + c] = (center[c] + ((center[c] + center[c - 4] + 1) >> 1) + 1) >> 1;
+            out[x * 8 + 4 + c] = (center[c] + ((center[c] + center[c + 4] + 1) >> 1) + 1) >> 1;
+        }
+    }
+}
+
+void R2DEngine::Bloom::combine(uint8_t* out, const uint8_t* in, const uint8_t* near, const uint8_t* far, uint16_t intensity, int32_t count) {
+    int32_t i = 0;
+#if R2D_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i scale = _mm_set1_epi16(static_cast<int16_t>(intensity));
+    for (; i + 16 <= count; i += 16) {
+        __m128i n = _mm_loadu_si128(reinterpret_cast<const __m128i*>(near + i));
+        __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(far + i));
+        __m128i glow = _mm_avg_epu8(n, _mm_avg_epu8(n, f));
+        // (glow << 8) * intensity >> 16 is glow * intensity / 256
+        __m128i lo = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpacklo_epi8(glow, zero), 8), scale);
+        __m128i hi = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpackhi_epi8(glow, zero), 8), scale);
+        __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_adds_epu8(source, _mm_packus_epi16(lo, hi)));
+    }
+#endif
+    for (; i < count; i ++) {
+        uint32_t glow = (near[i] + ((near[i] + far[i] + 1) >> 1) + 1) >> 1;
+        out[i] = std::min<uint32_t>(255, in[i] + std::min<uint32_t>(255, (glow * intensity) >> 8));
+    }
+}
+
+void R2DEngine::Bloom::apply(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height, ThreadPool& pool) {
+    int32_t halfWidth = (width + 1) / 2;
+    int32_t halfHeight = (height + 1) / 2;
+    bright.resize(halfWidth * halfHeight * 4);
+    blurred.resize(halfWidth * halfHeight * 4);
+    wide.resize(halfWidth * 2 * halfHeight * 4);
+    int32_t rowSize = width * 4;
+
+    pool.parallelFor(0, halfHeight, [&](int32_t begin, int32_t end) {
+        for (int32_t y = begin; y < end; y ++) {
+            const uint8_t* row0 = src + y * 2 * rowSize;
+            const uint8_t* row1 = src + std::min(y * 2 + 1, height - 1) * rowSize;
+            brightPass(bright.data() + y * halfWidth * 4, row0, row1, width, threshold);
+        }
+    });
+
+    blur.apply(bright.data(), blurred.data(), halfWidth, halfHeight, pool);
+
+    pool.parallelFor(0, halfHeight, [&](int32_t begin, int32_t end) {
+        static thread_local std::vector<uint8_t> padded;
+        padded.resize((halfWidth + 2) * 4);
+        for (int32_t y = begin; y < end; y ++) {
+            const uint8_t* row = blurred.data() + y * halfWidth * 4;
+            memcpy(padded.data() + 4, row, halfWidth * 4);
+            memcpy(padded.data(), row, 4);
+            memcpy(padded.data() + (halfWidth + 1) * 4, row + (halfWidth - 1) * 4, 4);
+            expand(wide.data() + y * halfWidth * 8, padded.data(), halfWidth);
+        }
+    });
+
+    pool.parallelFor(0, height, [&](int32_t begin, int32_t end) {
+        for (int32_t y = begin; y < end; y ++) {
+            // even rows sit a quarter pixel above their half resolution row, odd rows below
+            int32_t near = y / 2;
+            int32_t far = y % 2 ? std::min(near + 1, halfHeight - 1) : std::max(near - 1, 0);
+            combine(dst + y * rowSize, src + y * rowSize, wide.data() + near * halfWidth * 8, wide.data() + far * halfWidth * 8, intensity, rowSize);
+        }
+    });
+}
+
+R2DEngine::ColorGrade::ColorGrade(int32_t size) {
+    this->size = std::max(size, 2);
+    buildIndex();
+    bake([](Color color) {
+        return color;
+    });
+}
+
+void R2DEngine::ColorGrade::buildIndex() {
+    // lower grid point and 8 bit distance to it for every channel value
+    for (int32_t v = 0; v < 256; v ++) {
+        int32_t scaled = v * (size - 1) * 256 / 255;
+        index[v] = std::min(scaled >> 8, size - 2);
+        fraction[v] = scaled - index[v] * 256;
+    }
+}
+
+void R2DEngine::ColorGrade::bake(const std::function<Color(Color)>& grade) {
+    table.resize(size * size * size * 4);
+    for (int32_t b = 0; b < size; b ++) {
+        for (int32_t g = 0; g < size; g ++) {
+            for (int32_t r = 0; r < size; r ++) {
+                Color color = grade(Color(r * 255 / (size - 1), g * 255 / (size - 1), b * 255 / (size - 1)));
+                uint8_t* entry = table.data() + ((b * size + g) * size + r) * 4;
+                entry[0] = color.r;
+                entry[1] = color.g;
+                entry[2] = color.b;
+                entry[3] = 0;
+            }
+        }
+    }
+}
+
+bool R2DEngine::ColorGrade::loadCube(const char* path) {
+    std::ifstream fileStream(path, std::ios::in);
+    if (!fileStream.is_open()) {
+        DEBUG_ERROR("Failed to read LUT:");
+        DEBUG_ERROR(path);
+        return false;
+    }
+
+    int32_t cubeSize = 0;
+    bool valid = true;
+    std::vector<uint8_t> entries;
+    std::string line;
+    while (valid && std::getline(fileStream, line)) {
+        std::istringstream words(line);
+        std::string first;
+        if (!(words >> first) || first[0] == '#') {
+            continue;
+        }
+        if (first == "LUT_3D_SIZE") {
+            valid = static_cast<bool>(words >> cubeSize);
+        } else if (isdigit(static_cast<unsigned char>(first[0])) || first[0] == '-' || first[0] == '.') {
+            // rewind so the stream parses all three values and reports bad ones
+            words.clear();
+            words.seekg(0);
+            float values[3];
+            valid = static_cast<bool>(words >> values[0] >> values[1] >> values[2]);
+            for (float value : values) {
+                entries.push_back(static_cast<uint8_t>(std::round(std::min(std::max(value, 0.0f), 1.0f) * 255.0f)));
+            }
+            entries.push_back(0);
+        }
+    }
+
+    if (!valid || cubeSize < 2 || cubeSize > 256 || entries.size() != static_cast<size_t>(cubeSize * cubeSize * cubeSize * 4)) {
+        DEBUG_ERROR("Invalid LUT:");
+        DEBUG_ERROR(path);
+        return false;
+    }
+    size = cubeSize;
+    table = std::move(entries);
+    buildIndex();
+    return true;
+}
+
+const char* R2DEngine::ColorGrade::getName() const {
+    return "grade";
+}
+
+void R2DEngine::ColorGrade::apply(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height, ThreadPool& pool) {
+    // entries are interpolated as value * 32, a lerp step is a + ((b - a) * 4 * fraction * 64 >> 16)
+    // which is a + (b - a) * fraction / 256 and keeps every product in 16 bits
+    pool.parallelFor(0, height, [&](int32_t begin, int32_t end) {
+        const int32_t strideG = size * 4;
+        const int32_t strideB = size * size * 4;
+#if R2D_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        auto entry = [](const uint8_t* at) {
+            int32_t value;
+            memcpy(&value, at, 4);
+            return value;
+        };
+        for (int32_t i = begin * width; i < end * width; i ++) {
+            const uint8_t* p = src + i * 4;
+            const uint8_t* c000 = table.data() + index[p[0]] * 4 + index[p[1]] * strideG + index[p[2]] * strideB;
+            const uint8_t* c001 = c000 + strideB;
+            // 16 bit lanes hold the corners pairwise as (red 0, red 1)
+            __m128i g0 = _mm_set_epi32(entry(c000 + strideG + 4), entry(c000 + strideG), entry(c000 + 4), entry(c000));
+            __m128i g1 = _mm_set_epi32(entry(c001 + strideG + 4), entry(c001 + strideG), entry(c001 + 4), entry(c001));
+            __m128i b0g0 = _mm_slli_epi16(_mm_unpacklo_epi8(g0, zero), 5);
+            __m128i b0g1 = _mm_slli_epi16(_mm_unpackhi_epi8(g0, zero), 5);
+            __m128i b1g0 = _mm_slli_epi16(_mm_unpacklo_epi8(g1, zero), 5);
+            __m128i b1g1 = _mm_slli_epi16(_mm_unpackhi_epi8(g1, zero), 5);
+
+            __m128i fb = _mm_set1_epi16(static_cast<int16_t>(fraction[p[2]] << 6));
+            __m128i v0 = _mm_add_epi16(b0g0, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(b1g0, b0g0), 2), fb));
+            __m128i v1 = _mm_add_epi16(b0g1, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(b1g1, b0g1), 2), fb));
+            __m128i fg = _mm_set1_epi16(static_cast<int16_t>(fraction[p[1]] << 6));
+            __m128i v = _mm_add_epi16(v0, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(v1, v0), 2), fg));
+            __m128i fr = _mm_set1_epi16(static_cast<int16_t>(fraction[p[0]] << 6));
+            __m128i r1 = _mm_unpackhi_epi64(v, v);
+            v = _mm_add_epi16(v, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(r1, v), 2), fr));
+
+            v = _mm_srli_epi16(_mm_add_epi16(v, _mm_set1_epi16(16)), 5);
+            int32_t color = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+            memcpy(dst + i * 4, &color, 4);
+            dst[i * 4 + 3] = p[3];
+        }
+#else
+        auto lerp = [](int32_t a, int32_t b, int32_t f) {
+            return a + (((b - a) * 4 * (f * 64)) >> 16);
+        };
+        for (int32_t i = begin * width; i < end * width; i ++) {
+            const uint8_t* p = src + i * 4;
+            int32_t fr = fraction[p[0]];
+            int32_t fg = fraction[p[1]];
+            int32_t fb = fraction[p[2]];
+            const uint8_t* c000 = table.data() + index[p[0]] * 4 + index[p[1]] * strideG + index[p[2]] * strideB;
+            for (int32_t c = 0; c < 3; c ++) {
+                const uint8_t* c00 = c000 + c;
+                const uint8_t* c01 = c00 + strideB;
+                int32_t v0 = lerp(c00[0] << 5, c01[0] << 5, fb);
+                int32_t v1 = lerp(c00[4] << 5, c01[4] << 5, fb);
+                int32_t v2 = lerp(c00[strideG] << 5, c01[strideG] << 5, fb);
+                int32_t v3 = lerp(c00[strideG + 4] << 5, c01[strideG + 4] << 5, fb);
+                int32_t value = lerp(lerp(v0, v2, fg), lerp(v1, v3, fg), fr);
+                dst[i * 4 + c] = static_cast<uint8_t>(std::min(std::max((value + 16) >> 5, 0), 255));
+            }
+            dst[i * 4 + 3] = p[3];
+        }
+#endif
+    });
+}
+
+R2DEngine::Crt::Crt(float scanline, float mask, float vignette) : scanline(scanline), mask(mask), vignette(vignette) {
+    cachedWidth = 0;
+    cachedHeight = 0;
+}
+
+const char* R2DEngine::Crt::getName() const {
+    return "crt";
+}
+
+void R2DEngine::Crt::apply(const uint8_t* src, uint8_t* dst, int32_t width, int32_t height, ThreadPool& pool) {
+    if (cachedWidth != width || cachedHeight != height) {
+        cachedWidth = width;
+        cachedHeight = height;
+        rowScale.resize(height);
+        for (int32_t y = 0; y < height; y ++) {
+            float d = 2.0f * (y + 0.5f) / height - 1.0f;
+            float factor = (1.0f - vignette * d * d) * (y % 2 ? 1.0f - scanline : 1.0f);
+            rowScale[y] = static_cast<uint16_t>(std::round(std::min(std::max(factor, 0.0f), 1.99f) * 32768.0f));
+        }
+        columnScale.resize(width * 4);
+        for (int32_t x = 0; x < width; x ++) {
+            float d = 2.0f * (x + 0.5f) / width - 1.0f;
+            float factor = 1.0f - vignette * d * d;
+            for (int32_t c = 0; c < 3; c ++) {
+                // each column lets one of red, green, blue through unmasked
+                float channel = factor * (x % 3 == c ? 1.0f : 1.0f - mask);
+                columnScale[x * 4 + c] = static_cast<uint16_t>(std::round(std::min(std::max(channel, 0.0f), 1.99f) * 32768.0f));
+            }
+            columnScale[x * 4 + 3] = 32768;
+        }
+    }
+
+    // factor = column * row >> 16 has 1.0 at 16384, out = (in << 2) * factor >> 16
+    int32_t rowSize = width * 4;
+    pool.parallelFor(0, height, [&](int32_t begin, int32_t end) {
+        for (int32_t y = begin; y < end; y ++) {
+            const uint8_t* in = src + y * rowSize;
+            uint8_t* out = dst + y * rowSize;
+            uint32_t scale = rowScale[y];
+            int32_t i = 0;
+#if R2D_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i alpha = _mm_set1_epi32(static_cast<int32_t>(0xff000000));
+            const __m128i row = _mm_set1_epi16(static_cast<int16_t>(scale));
+            for (; i + 16 <= rowSize; i += 16) {
+                __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+                __m128i lo = _mm_mulhi_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(columnScale.data() + i)), row);
+                __m128i hi = _mm_mulhi_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(columnScale.data() + i + 8)), row);
+                lo = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpacklo_epi8(t, zero), 2), lo);
+                hi = _mm_mulhi_epu16(_mm_slli_epi16(_mm_unpackhi_epi8(t, zero), 2), hi);
+                __m128i color = _mm_andnot_si128(alpha, _mm_packus_epi16(lo, hi));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(color, _mm_and_si128(alpha, t)));
+            }
+#endif
+            for (; i < rowSize; i ++) {
+                uint32_t factor = (columnScale[i] * scale) >> 16;
+                out[i] = i % 4 == 3 ? in[i] : std::min<uint32_t>(255, ((in[i] << 2) * factor) >> 16);
+            }
+        }
+    });
+}
+
+R2DEngine::Path::Path(float tolerance) : tolerance(std::max(tolerance, 0.01f)) {}
+
+R2DEngine::Path::Point R2DEngine::Path::current() const {
+    if (contours.empty() || contours.back().points.empty()) {
+        return {0.0f, 0.0f};
+    }
+    const Contour& contour = contours.back();
+    return contour.closed ? contour.points.front() : contour.points.back();
+}
+
+R2DEngine::Path& R2DEngine::Path::moveTo(float x, float y) {
+    contours.emplace_back();
+    contours.back().points.push_back({x, y});
+    return *this;
+}
+
+R2DEngine::Path& R2DEngine::Path::lineTo(float x, float y) {
+    if (contours.empty() || contours.back().closed) {
+        Point start = current();
+        moveTo(start.x, start.y);
+    }
+    contours.back().points.push_back({x, y});
+    return *this;
+}
+
+R2DEngine::Path& R2DEngine::Path::quadTo(float cx, float cy, float x, float y) {
+    Point p0 = current();
+    // the polyline of n segments strays at most |p0 - 2c + p1| / (4n^2)
+    float dx = p0.x - 2.0f * cx + x;
+    float dy = p0.y - 2.0f * cy + y;
+    int32_t n = std::max(1, static_cast<int32_t>(std::ceil(std::sqrt(std::sqrt(dx * dx + dy * dy) / (4.0f * tolerance)))));
+    for (int32_t i = 1; i <= n; i ++) {
+        float t = static_cast<float>(i) / n;
+        float u = 1.0f - t;
+        lineTo(u * u * p0.x + 2.0f * u * t * cx + t * t * x, u * u * p0.y + 2.0f * u * t * cy + t * t * y);
+    }
+    return *this;
+}
+
+R2DEngine::Path& R2DEngine::Path::cubicTo(float c1x, float c1y, float c2x, float c2y, float x, float y) {
+    Point p0 = current();
+    // the polyline of n segments strays at most 3 * dd / (4n^2)
+    float ax = p0.x - 2.0f * c1x + c2x;
+    float ay = p0.y - 2.0f * c1y + c2y;
+    float bx = c1x - 2.0f * c2x + x;
+    float by = c1y - 2.0f * c2y + y;
+    float dd = std::sqrt(std::max(ax * ax + ay * ay, bx * bx + by * by));
+    int32_t n = std::max(1, static_cast<int32_t>(std::ceil(std::sqrt(0.75f * dd / tolerance))));
+    for (int32_t i = 1; i <= n; i ++) {
+        float t = static_cast<float>(i) / n;
+        float u = 1.0f - t;
+        float w0 = u * u * u;
+        float w1 = 3.0f * u * u * t;
+        float w2 = 3.0f * u * t * t;
+        float w3 = t * t * t;
+        lineTo(w0 * p0.x + w1 * c1x + w2 * c2x + w3 * x, w0 * p0.y + w1 * c1y + w2 * c2y + w3 * y);
+    }
+    return *this;
+}
+
+R2DEngine::Path& R2DEngine::Path::close() {
+    if (!contours.empty()) {
+        contours.back().closed = true;
+    }
+    return *this;
+}
+
+R2DEngine::Path& R2DEngine::Path::addRect(float x, float y, float w, float h) {
+    return moveTo(x, y).lineTo(x + w, y).lineTo(x + w, y + h).lineTo(x, y + h).close();
+}
+
+R2DEngine::Path& R2DEngine::Path::addEllipse(float cx, float cy, float rx, float ry) {
+    // four cubic quarter arcs
+    const float k = 0.5522847498f;
+    moveTo(cx + rx, cy);
+    cubicTo(cx + rx, cy + ry * k, cx + rx * k, cy + ry, cx, cy + ry);
+    cubicTo(cx - rx * k, cy + ry, cx - rx, cy + ry * k, cx - rx, cy);
+    cubicTo(cx - rx, cy - ry * k, cx - rx * k, cy - ry, cx, cy - ry);
+    cubicTo(cx + rx * k, cy - ry, cx + rx, cy - ry * k, cx + rx, cy);
+    return close();
+}
+
+R2DEngine::Path& R2DEngine::Path::addCircle(float cx, float cy, float r) {
+    return addEllipse(cx, cy, r, r);
+}
+
+void R2DEngine::Path::clear() {
+    contours.clear();
+}
+
+bool R2DEngine::Path::empty() const {
+    return contours.empty();
+}
+
+R2DEngine::Rasterizer::Rasterizer() {
+    width = 0;
+    height = 0;
+    top = 0;
+    bottom = 0;
+    left = 0;
+    right = 0;
+    minY = 0;
+    maxY = 0;
+}
+
+void R2DEngine::Rasterizer::reset(int32_t width, int32_t height) {
+    this->width = width;
+    this->height = height;
+    if (static_cast<int32_t>(rows.size()) < height) {
+        rows.resize(height);
+    }
+    top = height;
+    bottom = 0;
+}
+
+void R2DEngine::Rasterizer::addCell(int32_t y, int32_t x, float area) {
+    // cells right of the target never reach a visible pixel, cells left
+    // of it add to every pixel of the row exactly like a cell at 0 would
+    if (x >= width) {
+        return;
+    }
+    rows[y].push_back({std::max(x, 0), area});
+    top = std::min(top, y);
+    bottom = std::max(bottom, y + 1);
+}
+
+void R2DEngine::Rasterizer::addLine(float x0, float y0, float x1, float y1) {
+    if (y0 == y1) {
+        return;
+    }
+    float dir = 1.0f;
+    if (y0 > y1) {
+        std::swap(x0, x1);
+        std::swap(y0, y1);
+        dir = -1.0f;
+    }
+    if (y1 <= 0.0f || y0 >= height) {
+        return;
+    }
+
+    float dxdy = (x1 - x0) / (y1 - y0);
+    float x = x0;
+    if (y0 < 0.0f) {
+        x -= y0 * dxdy;
+    }
+    int32_t yEnd = std::min(height, static_cast<int32_t>(std::ceil(y1)));
+    for (int32_t y = std::max(0, static_cast<int32_t>(std::floor(y0))); y < yEnd; y ++) {
+        float dy = std::min(y + 1.0f, y1) - std::max(static_cast<float>(y), y0);
+        float xNext = x + dxdy * dy;
+        float d = dy * dir;
+        float xa = std::min(x, xNext);
+        float xb = std::max(x, xNext);
+        float xaFloor = std::floor(xa);
+        float xbCeil = std::ceil(xb);
+        int32_t xai = static_cast<int32_t>(xaFloor);
+        int32_t xbi = static_cast<int32_t>(xbCeil);
+
+        if (xbi <= xai + 1) {
+            // edge stays within one pixel column
+            float xm = 0.5f * (x + xNext) - xaFloor;
+            addCell(y, xai, d - d * xm);
+            addCell(y, xai + 1, d * xm);
+        } else {
+            float s = 1.0f / (xb - xa);
+            float xaFraction = xa - xaFloor;
+            float a0 = 0.5f * s * (1.0f - xaFraction) * (1.0f - xaFraction);
+            float xbFraction = xb - xbCeil + 1.0f;
+            float am = 0.5f * s * xbFraction * xbFraction;
+            addCell(y, xai, d * a0);
+            if (xbi == xai + 2) {
+                addCell(y, xai + 1, d * (1.0f - a0 - am));
+            } else {
+                float a1 = s * (1.5f - xaFraction);
+                addCell(y, xai + 1, d * (a1 - a0));
+                // columns fully crossed each take d * s, fold the ones
+                // left of the target into a single cell
+                int32_t first = xai + 2;
+                int32_t last = std::min(xbi - 1, width);
+                if (first < 0) {
+                    addCell(y, 0, d * s * (std::min(last, 0) - first));
+                    first = 0;
+                }
+                for (int32_t xi = first; xi < last; xi ++) {
+                    addCell(y, xi, d * s);
+                }
+                float a2 = a1 + (xbi - xai - 3) * s;
+                addCell(y, xbi - 1, d * (1.0f - a2 - am));
+            }
+            addCell(y, xbi, d * am);
+        }
+        x = xNext;
+    }
+}
+
+void R2DEngine::Rasterizer::addFill(const Path& path) {
+    for (const Path::Contour& contour : path.contours) {
+        size_t count = contour.points.size();
+        for (size_t i = 0; i < count; i ++) {
+            // filling always closes the contour
+            const Path::Point& a = contour.points[i];
+            const Path::Point& b = contour.points[(i + 1) % count];
+            addLine(a.x, a.y, b.x, b.y);
+        }
+    }
+}
+
+void R2DEngine::Rasterizer::addPolygon(const std::vector<Path::Point>& points) {
+    for (size_t i = 0; i < points.size(); i ++) {
+        const Path::Point& a = points[i];
+        const Path::Point& b = points[(i + 1) % points.size()];
+        addLine(a.x, a.y, b.x, b.y);
+    }
+}
+
+void R2DEngine::Rasterizer::addArc(std::vector<Path::Point>& outline, Path::Point center, float vx, float vy, float sweep, bool includeEnd) {
+    // steps short enough that the chords stay within STROKE_TOLERANCE of the arc
+    float radius = std::sqrt(vx * vx + vy * vy);
+    float step = radius > STROKE_TOLERANCE ? 2.0f * std::acos(1.0f - STROKE_TOLERANCE / radius) : 3.14159265f;
+    int32_t steps = std::max(1, static_cast<int32_t>(std::ceil(std::fabs(sweep) / step)));
+    int32_t last = includeEnd ? steps : steps - 1;
+    for (int32_t k = 1; k <= last; k ++) {
+        float angle = sweep * k / steps;
+        float c = std::cos(angle);
+        float s = std::sin(angle);
+        outline.push_back({center.x + vx * c - vy * s, center.y + vx * s + vy * c});
+    }
+}
+
+void R2DEngine::Rasterizer::addOffset(std::vector<Path::Point>& outline, const std::vector<Path::Point>& points, bool closed, float half) {
+    // walks the left side of the polyline with round joins on the outer
+    // side of a turn. on the inner side the offsets are cut where they
+    // meet, which keeps the outline simple, and it pivots through the
+    // vertex when a segment is too short for that. the pivot and a path
+    // that crosses or doubles back on itself leave overlapping outline,
+    // and edges inside the overlap come out too strong
+    size_t count = points.size();
+    size_t segments = closed ? count : count - 1;
+    std::vector<Path::Point> normals(segments);
+    std::vector<float> lengths(segments);
+    for (size_t i = 0; i < segments; i ++) {
+        const Path::Point& a = points[i];
+        const Path::Point& b = points[(i + 1) % count];
+        float dx = b.x - a.x;
+        float dy = b.y - a.y;
+        lengths[i] = std::sqrt(dx * dx + dy * dy);
+        normals[i] = {-dy / lengths[i] * half, dx / lengths[i] * half};
+    }
+
+    if (!closed) {
+        outline.push_back({points[0].x + normals[0].x, points[0].y + normals[0].y});
+    }
+    for (size_t i = 0; i < segments; i ++) {
+        const Path::Point& v = points[(i + 1) % count];
+        const Path::Point& n = normals[i];
+        if (!closed && i + 1 == segments) {
+            outline.push_back({v.x + n.x, v.y + n.y});
+            break;
+        }
+        size_t j = (i + 1) % segments;
+        const Path::Point& next = normals[j];
+        float cross = n.x * next.y - n.y * next.x;
+        float dot = n.x * next.x + n.y * next.y;
+        if (cross < 0.0f || (cross == 0.0f && dot < 0.0f)) {
+            outline.push_back({v.x + n.x, v.y + n.y});
+            float sweep = cross == 0.0f ? -3.14159265f : std::atan2(cross, dot);
+            addArc(outline, v, n.x, n.y, sweep, true);
+        } else if (cross > 0.0f) {
+            // the offsets meet half * tan(turn / 2) back along both segments
+            float scale = half * half / (half * half + dot);
+            if (half * cross / (half * half + dot) <= std::min(lengths[i], lengths[j])) {
+                outline.push_back({v.x + (n.x + next.x) * scale, v.y + (n.y + next.y) * scale});
+            } else {
+                outline.push_back({v.x + n.x, v.y + n.y});
+                outline.push_back(v);
+                outline.push_back({v.x + next.x, v.y + next.y});
+            }
+        } else {
+            outline.push_back({v.x + n.x, v.y + n.y});
+        }
+    }
+}
+
+void R2DEngine::Rasterizer::addCap(std::vector<Path::Point>& outline, const std::vector<Path::Point>& points, float half, LineCap cap) {
+    // from the left side to the right side around the last point
+    const Path::Point& end = points[points.size() - 1];
+    const Path::Point& before = points[points.size() - 2];
+    float dx = end.x - before.x;
+    float dy = end.y - before.y;
+    float length = std::sqrt(dx * dx + dy * dy);
+    dx = dx / length * half;
+    dy = dy / length * half;
+    if (cap == SQUARE) {
+        outline.push_back({end.x - dy + dx, end.y + dx + dy});
+        outline.push_back({end.x + dy + dx, end.y - dx + dy});
+    } else if (cap == ROUND) {
+        addArc(outline, end, -dy, dx, -3.14159265f, false);
+    }
+}
+
+void R2DEngine::Rasterizer::addStroke(const Path& path, float strokeWidth, LineCap cap) {
+    float half = strokeWidth * 0.5f;
+    std::vector<Path::Point> outline;
+    for (const Path::Contour& contour : path.contours) {
+        // drop repeated points so every segment has a direction
+        std::vector<Path::Point> points;
+        for (const Path::Point& point : contour.points) {
+            if (points.empty() || point.x != points.back().x || point.y != points.back().y) {
+                points.push_back(point);
+            }
+        }
+        bool closed = contour.closed && points.size() > 2;
+        if (closed && points.front().x == points.back().x && points.front().y == points.back().y) {
+            points.pop_back();
+        }
+
+        outline.clear();
+        if (points.size() == 1) {
+            if (cap == ROUND) {
+                addArc(outline, points[0], half, 0.0f, 2.0f * 3.14159265f, true);
+                addPolygon(outline);
+            }
+            continue;
+        }
+        if (points.size() < 2) {
+            continue;
+        }
+
+        if (closed) {
+            // outer and inner loops wind opposite ways and leave the middle empty
+            addOffset(outline, points, true, half);
+            addPolygon(outline);
+            outline.clear();
+            std::reverse(points.begin(), points.end());
+            addOffset(outline, points, true, half);
+            addPolygon(outline);
+        } else {
+            addOffset(outline, points, false, half);
+            addCap(outline, points, half, cap);
+            std::reverse(points.begin(), points.end());
+            addOffset(outline, points, false, half);
+            addCap(outline, points, half, cap);
+            addPolygon(outline);
+        }
+    }
+}
+
+void R2DEngine::Rasterizer::render(uint8_t* target, Color color, FillRule rule) {
+    left = width;
+    right = 0;
+    minY = top;
+    maxY = bottom;
+    for (int32_t y = top; y < bottom; y ++) {
+        std::vector<Cell>& cells = rows[y];
+        if (cells.empty()) {
+            continue;
+        }
+        std::sort(cells.begin(), cells.end(), [](const Cell& a, const Cell& b) {
+            return a.x < b.x;
+        });
+
+        uint8_t* row = target + y * width * 4;
+        float area = 0.0f;
+        size_t i = 0;
+        while (i < cells.size()) {
+            int32_t x = cells[i].x;
+            while (i < cells.size() && cells[i].x == x) {
+                area += cells[i].area;
+                i ++;
+            }
+            // the cell and every pixel up to the next cell share the coverage
+            int32_t next = i < cells.size() ? cells[i].x : width;
+            float coverage = std::fabs(area);
+            if (rule == EVENODD) {
+                coverage = std::fmod(coverage, 2.0f);
+                if (coverage > 1.0f) {
+                    coverage = 2.0f - coverage;
+                }
+            }
+            uint8_t alpha = static_cast<uint8_t>(std::min(coverage, 1.0f) * color.a + 0.5f);
+            if (alpha > 0) {
+                Blend::solid(row + x * 4, next - x, color.r, color.g, color.b, alpha);
+                left = std::min(left, x);
+                right = std::max(right, next);
+            }
+        }
+        cells.clear();
+    }
+    top = height;
+    bottom = 0;
+}
 
-    // graphics
-#if USE_OPENGL
-    GLFWwindow* window;
-    GLuint bufferTexture;
-    GLubyte* bufferData;
-    GLuint vao, ibo, vbo;
-#elif USE_SDL2
-    SDL_Window* window;
-    SDL_Renderer* renderer;
-    SDL_Texture* bufferTexture;
-    uint8_t* bufferData;
-#endif
+R2DEngine::AssetManager::AssetManager(size_t workerCount, const std::string& cacheDirectory)
+    : cacheDirectory(cacheDirectory), workerCount(std::max<size_t>(1, workerCount)), imageInitialized(false), cancelled(false) {}
 
-    // events
-#if USE_SDL2
-    SDL_Event event;
-#endif
+R2DEngine::AssetManager::~AssetManager() {
+    shutdown();
+}
 
-protected:
-    // game
-    struct Coord {
-        uint32_t x = 0;
-        uint32_t y = 0;
-        Coord(uint32_t x = 0, uint32_t y = 0) : x(x), y(y) {}
-    };
+void R2DEngine::AssetManager::shutdown() {
+    std::unique_lock<std::mutex> lock(mutex);
+    // workers never take the mutex, so joining them under it is safe
+    cancelled = true;
+    workers.reset();
+    cancelled = false;
+    images.clear();
+    // only after the join, SDL_image must not go away under a running decode
+    if (imageInitialized) {
+        IMG_Quit();
+        imageInitialized = false;
+    }
+}
 
-    struct Color {
-        uint8_t r = 0;
-        uint8_t g = 0;
-        uint8_t b = 0;
-        uint8_t a = 255;
-        Color(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t a = 255) : r(r), g(g), b(b), a(a) {}
-    };
-    
-    // graphics
-    int32_t screenWidth;
-    int32_t screenHeight;
-    int32_t innerWidth;
-    int32_t innerHeight;
-    std::string windowTitle;
-#if USE_OPENGL
-    GLuint shader;
-#endif
+R2DEngine::ImageHandle R2DEngine::AssetManager::loadImage(const std::string& path) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = images.find(path);
+    if (it != images.end()) {
+        return it->second;
+    }
 
-    // events
-    enum InputState {
-        UNKNOWN,
-        PRESS,
-        RELEASE,
-        REPEAT
-    };
-    double mousePosX;
-    double mousePosY;
-    
-private:
-    void gameLoop();
+    if (!workers) {
+        // SDL_image loads its codecs here, on the calling thread, so workers never race to do it
+        imageInitialized = (IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG) != 0;
+        if (!imageInitialized) {
+            DEBUG_ERROR("Failed to initialize SDL_image:");
+            DEBUG_ERROR(IMG_GetError());
+        }
+        workers = std::make_unique<ThreadPool>(workerCount);
+    }
 
-    void clearBuffer();
-    void swapBuffers();
+    auto promise = std::make_shared<std::promise<Image>>();
+    ImageHandle handle = promise->get_future().share();
+    images[path] = handle;
+    workers->enqueue([this, promise, path]() {
+        promise->set_value(cancelled ? Image() : decodeImage(path));
+    });
+    return handle;
+}
 
-#if USE_OPENGL
-    std::string importShader(const char* shaderPath);
-    void addShader(GLuint program, const char* shaderCode, GLenum shaderType);
-    void compileShaders(const char* vCode, const char* fCode);
-#endif
+void R2DEngine::AssetManager::release(const std::string& path) {
+    std::unique_lock<std::mutex> lock(mutex);
+    images.erase(path);
+}
 
-public:
-    R2DEngine();
-    virtual ~R2DEngine();
+bool R2DEngine::AssetManager::isReady(const ImageHandle& handle) {
+    return handle.valid() && handle.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
 
-public:
-    // user interfaces
-    virtual bool onCreate() = 0;
-    virtual bool onUpdate(double deltaTime) = 0;
-    virtual bool onDestroy() {
-        return true;
+R2DEngine::Image R2DEngine::AssetManager::decodeImage(const std::string& path) {
+    std::error_code error;
+    SourceKey key;
+    key.size = std::filesystem::file_size(path, error);
+    if (!error) {
+        key.time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    }
+    if (error) {
+        DEBUG_ERROR("Failed to read image:");
+        DEBUG_ERROR(path.c_str());
+        return Image();
+    }
+    // FNV-1a over the path, size and time are checked against the header
+    key.hash = 14695981039346656037ull;
+    for (char byte : path) {
+        key.hash = (key.hash ^ static_cast<uint8_t>(byte)) * 1099511628211ull;
     }
 
-public:
-    // game
-    bool construct(int32_t screenWidth = 800, int32_t screenHeight = 600, int32_t innerWidth = 800, int32_t innerHeight = 600);
-    void init(const char* vShaderPath = "", const char* fShaderPath = "");
+    // a warm cache never opens the source file
+    Image image = readCache(key);
+    if (image.data()) {
+        return image;
+    }
 
-public:
-    // events
-    InputState getKeyState(int key) const;
-    InputState getMouseState(int mouseButton) const;
+    std::ifstream fileStream(path, std::ios::in | std::ios::binary);
+    std::vector<char> bytes(key.size);
+    if (!fileStream.is_open() || !fileStream.read(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+        DEBUG_ERROR("Failed to read image:");
+        DEBUG_ERROR(path.c_str());
+        return Image();
+    }
+    fileStream.close();
 
+    SDL_Surface* loaded = IMG_Load_RW(SDL_RWFromConstMem(bytes.data(), static_cast<int>(bytes.size())), 1);
+    if (!loaded) {
+        DEBUG_ERROR("Failed to decode image:");
+        DEBUG_ERROR(path.c_str());
+        DEBUG_ERROR(IMG_GetError());
+        return Image();
+    }
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_FreeSurface(loaded);
+    if (!converted) {
+        DEBUG_ERROR("Failed to convert image:");
+        DEBUG_ERROR(path.c_str());
+        return Image();
+    }
 
-public:
-    // graphics
-    void drawPoint(Coord coord, Color color);
-    void drawLine(Coord coord1, Coord coord2, Color color);
-};
+    image = Image(converted->w, converted->h);
+    for (int32_t y = 0; y < image.height; y ++) {
+        memcpy(image.data() + y * image.width * 4, static_cast<uint8_t*>(converted->pixels) + y * converted->pitch, image.width * 4);
+    }
+    SDL_FreeSurface(converted);
 
-#if USE_OPENGL
-void glfwErrorCallback(int error, const char* description) {
-    DEBUG_MSG(description);
+    writeCache(key, image);
+    return image;
 }
 
-void glfwFramebufferSizeCallback(GLFWwindow* window, int screenWidth, int screenHeight) {
-    glViewport(0, 0, screenWidth, screenHeight);
+bool R2DEngine::AssetManager::headerMatches(const CacheHeader& header, const SourceKey& key) {
+    return memcmp(header.magic, CACHE_MAGIC, 4) == 0 && header.version == CACHE_VERSION
+        && header.hash == key.hash && header.sourceSize == key.size && header.sourceTime == key.time
+        && header.width > 0 && header.height > 0;
+}
+
+std::string R2DEngine::AssetManager::cachePath(const SourceKey& key) const {
+    // one file per source path, a changed source overwrites its stale entry
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key.hash << ".rgba";
+    return (std::filesystem::path(cacheDirectory) / name.str()).string();
 }
+
+R2DEngine::Image R2DEngine::AssetManager::readCache(const SourceKey& key) {
+    if (cacheDirectory.empty()) {
+        return Image();
+    }
+    std::string path = cachePath(key);
+    CacheHeader header;
+
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return Image();
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < CACHE_HEADER_SIZE) {
+        close(fd);
+        return Image();
+    }
+    size_t size = info.st_size;
+    // private mapping so callers may draw into the pixels without touching the file
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return Image();
+    }
+    std::shared_ptr<uint8_t> mapping(static_cast<uint8_t*>(mapped), [size](uint8_t* base) {
+        munmap(base, size);
+    });
+
+    memcpy(&header, mapping.get(), sizeof(header));
+    if (!headerMatches(header, key)
+        || size != CACHE_HEADER_SIZE + static_cast<size_t>(header.width) * header.height * 4) {
+        return Image();
+    }
+
+    Image image;
+    image.width = header.width;
+    image.height = header.height;
+    image.pixels = std::shared_ptr<uint8_t>(mapping, mapping.get() + CACHE_HEADER_SIZE);
+    return image;
+#else
+    std::ifstream fileStream(path, std::ios::in | std::ios::binary);
+    if (!fileStream.is_open() || !fileStream.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return Image();
+    }
+    if (!headerMatches(header, key)) {
+        return Image();
+    }
+    Image image(header.width, header.height);
+    fileStream.seekg(CACHE_HEADER_SIZE);
+    if (!fileStream.read(reinterpret_cast<char*>(image.data()), static_cast<std::streamsize>(image.width) * image.height * 4)) {
+        return Image();
+    }
+    return image;
 #endif
+}
 
+void R2DEngine::AssetManager::writeCache(const SourceKey& key, const Image& image) {
+    if (cacheDirectory.empty()) {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+
+    CacheHeader header;
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.hash = key.hash;
+    header.sourceSize = key.size;
+    header.sourceTime = key.time;
+    header.width = image.width;
+    header.height = image.height;
+    char padding[CACHE_HEADER_SIZE] = {0};
+
+    // write next to the final name and rename so readers never see a partial file
+    std::string path = cachePath(key);
+    std::ostringstream temporary;
+    temporary << path << "." << std::this_thread::get_id() << ".tmp";
+    std::ofstream fileStream(temporary.str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!fileStream.is_open()) {
+        DEBUG_ERROR("Failed to write asset cache:");
+        DEBUG_ERROR(path.c_str());
+        return;
+    }
+    fileStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    fileStream.write(padding, CACHE_HEADER_SIZE - sizeof(header));
+    fileStream.write(reinterpret_cast<const char*>(image.data()), static_cast<std::streamsize>(image.width) * image.height * 4);
+    fileStream.close();
+    if (!fileStream) {
+        std::filesystem::remove(temporary.str(), error);
+        return;
+    }
+    std::filesystem::rename(temporary.str(), path, error);
+}
 
 R2DEngine::R2DEngine() {
 #if USE_OPENGL
@@ -300,6 +2435,11 @@ R2DEngine::R2DEngine() {
     bufferData = nullptr;
 #endif
     loop = false;
+    frameCount = 0;
+    baseLayer = nullptr;
+    uploadTop = 0;
+    uploadBottom = 0;
+    presentData = nullptr;
 
     screenWidth = 0;
     screenHeight = 0;
@@ -415,11 +2555,6 @@ bool R2DEngine::construct(int32_t screenWidth, int32_t screenHeight, int32_t inn
         } else {
             renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
             SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-            if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
-                DEBUG_ERROR("Failed to load SDL_image: ");
-                DEBUG_ERROR(IMG_GetError());
-                return false;
-            }
             if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
                 DEBUG_ERROR("Failed to load SDL_mixer: ");
                 DEBUG_ERROR(Mix_GetError());
@@ -463,22 +2598,95 @@ void R2DEngine::init(const char* vShaderPath, const char* fShaderPath) {
     gameLoop();
 }
 
+R2DEngine::ThreadPool& R2DEngine::getThreadPool() {
+    if (!threadPool) {
+        threadPool = std::make_unique<ThreadPool>(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    }
+    return *threadPool;
+}
+
+uint64_t R2DEngine::getFrameCount() const {
+    return frameCount;
+}
+
 void R2DEngine::clearBuffer() {
+    uploadTop = 0;
+    uploadBottom = innerHeight;
 #if USE_OPENGL
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    memset(bufferData, 0, sizeof(GLubyte) * innerWidth * innerHeight * 4);
 #elif USE_SDL2
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
-    memset(bufferData, 0, sizeof(uint8_t) * innerWidth * innerHeight * 4);
 #endif
+    if (layers.empty()) {
+        memset(bufferData, 0, sizeof(uint8_t) * innerWidth * innerHeight * 4);
+    }
+    for (auto& layer : layers) {
+        layer->beginFrame();
+    }
+}
+
+void R2DEngine::compositeLayers() {
+    if (layers.empty()) {
+        return;
+    }
+    std::stable_sort(layers.begin(), layers.end(), [](const std::unique_ptr<Layer>& a, const std::unique_ptr<Layer>& b) {
+        return a->z < b->z;
+    });
+
+    // shaders rewrite bufferData in place, so nothing in it can be reused
+    bool full = pixelShader || rowShader || batchShader;
+    uploadTop = innerHeight;
+    uploadBottom = 0;
+    for (int32_t y = 0; y < innerHeight; y ++) {
+        if (full) {
+            damageLeft[y] = 0;
+            damageRight[y] = innerWidth;
+        }
+        for (auto& layer : layers) {
+            damageLeft[y] = std::min(damageLeft[y], layer->dirtyLeft[y]);
+            damageRight[y] = std::max(damageRight[y], layer->dirtyRight[y]);
+            layer->dirtyLeft[y] = innerWidth;
+            layer->dirtyRight[y] = 0;
+        }
+        if (damageLeft[y] < damageRight[y]) {
+            uploadTop = std::min(uploadTop, y);
+            uploadBottom = y + 1;
+        }
+    }
+
+    getThreadPool().parallelFor(uploadTop, uploadBottom, [this](int32_t begin, int32_t end) {
+        for (int32_t y = begin; y < end; y ++) {
+            int32_t left = damageLeft[y];
+            int32_t right = damageRight[y];
+            if (left >= right) {
+                continue;
+            }
+            uint8_t* row = bufferData + (y * innerWidth + left) * 4;
+            for (int32_t x = 0; x < right - left; x ++) {
+                row[x * 4 + 0] = 0;
+                row[x * 4 + 1] = 0;
+                row[x * 4 + 2] = 0;
+                row[x * 4 + 3] = 255;
+            }
+            for (auto& layer : layers) {
+                if (layer->visible && layer->opacity > 0) {
+                    Blend::over(row, layer->pixels.data() + (y * innerWidth + left) * 4, right - left, layer->opacity);
+                }
+            }
+            damageLeft[y] = innerWidth;
+            damageRight[y] = 0;
+        }
+    });
 }
 
 void R2DEngine::swapBuffers() {
 #if USE_OPENGL
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, bufferTexture);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, innerWidth, innerHeight, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)bufferData);
+    if (uploadTop < uploadBottom) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, uploadTop, innerWidth, uploadBottom - uploadTop, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)(presentData + uploadTop * innerWidth * 4));
+    }
     
     glBindVertexArray(vao);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
@@ -487,7 +2695,10 @@ void R2DEngine::swapBuffers() {
     glBindVertexArray(0);
     glfwSwapBuffers(window);
 #elif USE_SDL2
-    SDL_UpdateTexture(bufferTexture, nullptr, (void*)bufferData, innerWidth * 4);
+    if (uploadTop < uploadBottom) {
+        SDL_Rect rows = {0, uploadTop, innerWidth, uploadBottom - uploadTop};
+        SDL_UpdateTexture(bufferTexture, &rows, (void*)(presentData + uploadTop * innerWidth * 4), innerWidth * 4);
+    }
     SDL_RenderCopy(renderer,  bufferTexture, nullptr, nullptr);
     SDL_RenderPresent(renderer);
 #endif
@@ -499,8 +2710,7 @@ std::string R2DEngine::importShader(const char* shaderPath) {
         return "";
     }
 
-    std::string content;
-    std::ifstream fileStream(shaderPath, std::ios::in);
+    std::ifstream fileStream(shaderPath, std::ios::in | std::ios::binary);
 
     if (!fileStream.is_open()) {
         DEBUG_ERROR("Failed to read shader:");
@@ -508,11 +2718,7 @@ std::string R2DEngine::importShader(const char* shaderPath) {
         return "";
     }
 
-    std::string line = "";
-    while (!fileStream.eof()) {
-        std::getline(fileStream, line);
-        content.append(line + "\n");
-    }
+    std::string content((std::istreambuf_iterator<char>(fileStream)), std::istreambuf_iterator<char>());
 
     fileStream.close();
 
@@ -606,7 +2812,7 @@ void R2DEngine::gameLoop() {
                 deltaTime = time_b - time_a;
             }
             time_a = time_b;
-            std::string title = windowTitle + " - FPS: " + std::to_string(1.0 / deltaTime);
+            std::string title = windowTitle + " - FPS: " + std::to_string(1.0 / deltaTime) + getPostTimings();
             glfwSetWindowTitle(window, title.c_str());
 
             glfwPollEvents();
@@ -625,7 +2831,7 @@ void R2DEngine::gameLoop() {
             time_b = SDL_GetPerformanceCounter();
             deltaTime = (double)((time_b - time_a) / (double)SDL_GetPerformanceFrequency());
             time_a = time_b;
-            std::string title = windowTitle + " - FPS " + std::to_string(1.0 / deltaTime);
+            std::string title = windowTitle + " - FPS " + std::to_string(1.0 / deltaTime) + getPostTimings();
             SDL_SetWindowTitle(window, title.c_str());
             while (SDL_PollEvent(&event)) {
                 switch (event.type) {
@@ -645,10 +2851,15 @@ void R2DEngine::gameLoop() {
             SDL_GetWindowSize(window, &screenWidth, &screenHeight);
 #endif
             
+            frameCount ++;
             clearBuffer();
+            uniforms.time += deltaTime;
             if (!onUpdate(deltaTime)) {
                 loop = false;
             }
+            compositeLayers();
+            runShader();
+            runPostEffects();
             swapBuffers();
         }
 
@@ -659,6 +2870,9 @@ void R2DEngine::gameLoop() {
 
     DEBUG_MSG("game loop end");
 
+    // decodes use SDL_image, finish them before SDL goes away
+    assets.shutdown();
+
 #if USE_OPENGL
     if (ibo != 0) {
         glDeleteBuffers(1, &ibo);
@@ -685,7 +2899,6 @@ void R2DEngine::gameLoop() {
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     Mix_Quit();
-    IMG_Quit();
     SDL_Quit();
 
     DEBUG_MSG("SDL destroyed");
@@ -693,6 +2906,10 @@ void R2DEngine::gameLoop() {
 }
 
 void R2DEngine::drawPoint(Coord coord, Color color) {
+    if (Layer* layer = directLayer()) {
+        layer->drawPoint(coord, color);
+        return;
+    }
     if (0 <= coord.x && coord.x < innerWidth && 0 <= coord.y && coord.y < innerHeight) {
         bufferData[coord.y * innerWidth * 4 + coord.x * 4 + 0] = color.r;
         bufferData[coord.y * innerWidth * 4 + coord.x * 4 + 1] = color.g;
@@ -701,6 +2918,249 @@ void R2DEngine::drawPoint(Coord coord, Color color) {
     }
 }
 
+void R2DEngine::setPixelShader(PixelShader kernel) {
+    clearShader();
+    pixelShader = kernel;
+}
+
+void R2DEngine::setRowShader(RowShader kernel) {
+    clearShader();
+    rowShader = kernel;
+}
+
+void R2DEngine::setBatchShader(BatchShader kernel) {
+    clearShader();
+    batchShader = kernel;
+}
+
+void R2DEngine::clearShader() {
+    pixelShader = nullptr;
+    rowShader = nullptr;
+    batchShader = nullptr;
+}
+
+void R2DEngine::drawTileMap(TileMap& tileMap, int32_t scrollX, int32_t scrollY) {
+    if (Layer* layer = directLayer()) {
+        drawTileMap(*layer, tileMap, scrollX, scrollY);
+        return;
+    }
+    tileMap.draw(bufferData, innerWidth, innerHeight, scrollX, scrollY, frameCount);
+}
+
+void R2DEngine::drawTileMap(Layer& layer, TileMap& tileMap, int32_t scrollX, int32_t scrollY) {
+    tileMap.draw(layer.data(), layer.width, layer.height, scrollX, scrollY, frameCount);
+    int32_t left = std::max(-scrollX, 0);
+    int32_t top = std::max(-scrollY, 0);
+    int32_t right = tileMap.getMapWidth() * tileMap.getTileWidth() - scrollX;
+    int32_t bottom = tileMap.getMapHeight() * tileMap.getTileHeight() - scrollY;
+    layer.markDirty(left, top, right - left, bottom - top);
+}
+
+void R2DEngine::drawImage(Coord coord, const Image& image) {
+    if (Layer* layer = directLayer()) {
+        layer->drawImage(coord, image);
+        return;
+    }
+    if (!image.data() || coord.x >= static_cast<uint32_t>(innerWidth) || coord.y >= static_cast<uint32_t>(innerHeight)) {
+        return;
+    }
+    int32_t width = std::min<int32_t>(image.width, innerWidth - coord.x);
+    int32_t height = std::min<int32_t>(image.height, innerHeight - coord.y);
+    for (int32_t y = 0; y < height; y ++) {
+        memcpy(bufferData + ((coord.y + y) * innerWidth + coord.x) * 4, image.data() + y * image.width * 4, width * 4);
+    }
+}
+
+void R2DEngine::drawImage(Layer& layer, Coord coord, const Image& image) {
+    layer.drawImage(coord, image);
+}
+
+R2DEngine::Layer& R2DEngine::createLayer(const std::string& name, int32_t z, bool persistent) {
+    if (layers.empty()) {
+        // bufferData still holds the last cleared frame, rebuild all of it once
+        damageLeft.assign(innerHeight, 0);
+        damageRight.assign(innerHeight, innerWidth);
+        // created first so it sorts below the other z 0 layers
+        layers.emplace_back(new Layer(BASE_LAYER, innerWidth, innerHeight, 0, false));
+        baseLayer = layers.back().get();
+    }
+    layers.emplace_back(new Layer(name, innerWidth, innerHeight, z, persistent));
+    return *layers.back();
+}
+
+R2DEngine::Layer* R2DEngine::directLayer() {
+    if (layers.empty()) {
+        return nullptr;
+    }
+    if (!baseLayer) {
+        // the base layer was removed, bring it back on top of the others
+        layers.emplace_back(new Layer(BASE_LAYER, innerWidth, innerHeight, 0, false));
+        baseLayer = layers.back().get();
+    }
+    return baseLayer;
+}
+
+R2DEngine::Layer* R2DEngine::getLayer(const std::string& name) {
+    for (auto& layer : layers) {
+        if (layer->name == name) {
+            return layer.get();
+        }
+    }
+    return nullptr;
+}
+
+void R2DEngine::removeLayer(const std::string& name) {
+    for (auto it = layers.begin(); it != layers.end(); it ++) {
+        if ((*it)->name == name) {
+            // what it shows now and what it wiped since the last composite
+            for (int32_t y = 0; y < innerHeight; y ++) {
+                damageLeft[y] = std::min({damageLeft[y], (*it)->usedLeft[y], (*it)->dirtyLeft[y]});
+                damageRight[y] = std::max({damageRight[y], (*it)->usedRight[y], (*it)->dirtyRight[y]});
+            }
+            if (it->get() == baseLayer) {
+                baseLayer = nullptr;
+            }
+            layers.erase(it);
+            return;
+        }
+    }
+}
+
+void R2DEngine::removePostEffect(const PostEffect& effect) {
+    for (auto it = postEffects.begin(); it != postEffects.end(); it ++) {
+        if (it->get() == &effect) {
+            postEffects.erase(it);
+            return;
+        }
+    }
+}
+
+void R2DEngine::clearPostEffects() {
+    postEffects.clear();
+}
+
+std::string R2DEngine::getPostTimings() const {
+    std::ostringstream timings;
+    timings << std::fixed << std::setprecision(2);
+    for (auto& effect : postEffects) {
+        timings << " " << effect->getName() << " " << effect->time << "ms";
+    }
+    return timings.str();
+}
+
+void R2DEngine::runPostEffects() {
+    presentData = bufferData;
+    if (postEffects.empty()) {
+        return;
+    }
+    for (auto& buffer : postBuffers) {
+        buffer.resize(innerWidth * innerHeight * 4);
+    }
+
+    const uint8_t* src = bufferData;
+    for (size_t i = 0; i < postEffects.size(); i ++) {
+        uint8_t* dst = postBuffers[i % 2].data();
+        auto start = std::chrono::steady_clock::now();
+        postEffects[i]->apply(src, dst, innerWidth, innerHeight, getThreadPool());
+        postEffects[i]->time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        src = dst;
+    }
+    presentData = const_cast<uint8_t*>(src);
+    uploadTop = 0;
+    uploadBottom = innerHeight;
+}
+
+void R2DEngine::drawLine(Coord coord1, Coord coord2, Color color) {
+    Path path;
+    path.moveTo(coord1.x + 0.5f, coord1.y + 0.5f).lineTo(coord2.x + 0.5f, coord2.y + 0.5f);
+    strokePath(path, 1.0f, color, SQUARE);
+}
+
+void R2DEngine::fillPath(const Path& path, Color color, FillRule rule) {
+    if (Layer* layer = directLayer()) {
+        fillPath(*layer, path, color, rule);
+        return;
+    }
+    rasterizer.reset(innerWidth, innerHeight);
+    rasterizer.addFill(path);
+    rasterizer.render(bufferData, color, rule);
+}
+
+void R2DEngine::strokePath(const Path& path, float width, Color color, LineCap cap) {
+    if (Layer* layer = directLayer()) {
+        strokePath(*layer, path, width, color, cap);
+        return;
+    }
+    rasterizer.reset(innerWidth, innerHeight);
+    rasterizer.addStroke(path, width, cap);
+    rasterizer.render(bufferData, color, NONZERO);
+}
+
+void R2DEngine::fillPath(Layer& layer, const Path& path, Color color, FillRule rule) {
+    rasterizer.reset(layer.width, layer.height);
+    rasterizer.addFill(path);
+    rasterizer.render(layer.data(), color, rule);
+    layer.markDirty(rasterizer.left, rasterizer.minY, rasterizer.right - rasterizer.left, rasterizer.maxY - rasterizer.minY);
+}
+
+void R2DEngine::strokePath(Layer& layer, const Path& path, float width, Color color, LineCap cap) {
+    rasterizer.reset(layer.width, layer.height);
+    rasterizer.addStroke(path, width, cap);
+    rasterizer.render(layer.data(), color, NONZERO);
+    layer.markDirty(rasterizer.left, rasterizer.minY, rasterizer.right - rasterizer.left, rasterizer.maxY - rasterizer.minY);
+}
+
+void R2DEngine::runShader() {
+    if (!pixelShader && !rowShader && !batchShader) {
+        return;
+    }
+    uniforms.innerWidth = innerWidth;
+    uniforms.innerHeight = innerHeight;
+
+    auto toChannel = [](float value) {
+        return (uint8_t)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+    };
+
+    getThreadPool().parallelFor(0, innerHeight, [this, &toChannel](int32_t begin, int32_t end) {
+        for (int32_t y = begin; y < end; y ++) {
+            uint8_t* row = bufferData + y * innerWidth * 4;
+            if (rowShader) {
+                rowShader(y, row, uniforms);
+            } else if (batchShader) {
+                ShaderBatch batch;
+                batch.y = y;
+                for (int32_t x = 0; x < innerWidth; x += SHADER_BATCH_SIZE) {
+                    batch.x = x;
+                    batch.count = std::min(SHADER_BATCH_SIZE, innerWidth - x);
+                    uint8_t* pixel = row + x * 4;
+                    for (int32_t i = 0; i < SHADER_BATCH_SIZE; i ++) {
+                        // padding lanes repeat the last pixel so kernels never see garbage
+                        const uint8_t* p = pixel + std::min(i, batch.count - 1) * 4;
+                        batch.r[i] = p[0] * (1.0f / 255.0f);
+                        batch.g[i] = p[1] * (1.0f / 255.0f);
+                        batch.b[i] = p[2] * (1.0f / 255.0f);
+                        batch.a[i] = p[3] * (1.0f / 255.0f);
+                    }
+                    batchShader(batch, uniforms);
+                    for (int32_t i = 0; i < batch.count; i ++) {
+                        pixel[i * 4 + 0] = toChannel(batch.r[i]);
+                        pixel[i * 4 + 1] = toChannel(batch.g[i]);
+                        pixel[i * 4 + 2] = toChannel(batch.b[i]);
+                        pixel[i * 4 + 3] = toChannel(batch.a[i]);
+                    }
+                }
+            } else {
+                Color color;
+                for (int32_t x = 0; x < innerWidth; x ++) {
+                    memcpy(&color, row + x * 4, 4);
+                    pixelShader(x, y, uniforms, color);
+                    memcpy(row + x * 4, &color, 4);
+                }
+            }
+        }
+    });
+}
+
 R2DEngine::InputState R2DEngine::getKeyState(int key) const {
 #if USE_OPENGL
     int state = glfwGetKey(window, key);
@@ -1,7 +1,17 @@
 #define DEBUG_ENABLED 1
 //#define USE_SDL2 1
+//#define CPU_SHADER 1
 #include "R2DEngine.hpp"
 
+#if CPU_SHADER
+// cpu port of shaders/final.fsh
+static uint8_t channel(float n, float t, int32_t roundT, float scale, int32_t offset) {
+    int32_t x = roundT + static_cast<int32_t>((n + t) * scale) + offset;
+    x = x % 500;
+    return static_cast<uint8_t>(std::abs(255 - x));
+}
+#endif
+
 class Demo : public R2DEngine {
     GLint t_loc;
     GLint innerWidth_loc;
@@ -18,6 +28,22 @@ public:
         innerWidth_loc = glGetUniformLocation(shader, "innerWidth");
         innerHeight_loc = glGetUniformLocation(shader, "innerHeight");
 
+#if CPU_SHADER
+        setRowShader([](int32_t y, uint8_t* row, const ShaderUniforms& uniforms) {
+            float t = uniforms.values[0];
+            int32_t roundT = static_cast<int32_t>(std::round(t));
+            float scale = 1.2f / uniforms.innerWidth;
+            float fy = y + 0.5f;
+            for (int32_t i = 0; i < uniforms.innerWidth; i ++) {
+                float fx = i + 0.5f;
+                row[i * 4 + 0] = channel(fx * (uniforms.innerHeight - fy), t, roundT, scale, 255);
+                row[i * 4 + 1] = channel(fy * (uniforms.innerWidth - fx), t, roundT, scale, 0);
+                row[i * 4 + 2] = channel(fx * fy, t, roundT, scale, 128);
+                row[i * 4 + 3] = 255;
+            }
+        });
+#endif
+
         return true;
     }
 
@@ -27,6 +53,7 @@ public:
             t = 0.0f;
         }
 
+        uniforms.values[0] = t;
         glUniform1f(t_loc, t);
         glUniform1i(innerWidth_loc, innerWidth);
         glUniform1i(innerHeight_loc, innerHeight);
@@ -38,7 +65,11 @@ public:
 int main() {
     Demo demo;
     if (demo.construct(1280, 720, 1920, 1080)) {
+#if CPU_SHADER
+        demo.init();
+#else
         demo.init("", "./shaders/final.fsh");
+#endif
     }
 
     return 0;